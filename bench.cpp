@@ -0,0 +1,422 @@
+/** @file
+ * bench: micro benchmarks for the input parsers, statistics and rendering of ttyplot.
+ * Apache License 2.0
+ *
+ * Every benchmark runs RUNS times with the same generated data,
+ * the best run is printed to reduce noise from other processes.
+ */
+
+#define TTYPLOT_NO_MAIN
+#include "ttyplot.cpp"
+
+#include <chrono>
+#include <functional>
+
+#define RUNS 5
+// number of samples for the single value parsers and the statistics
+#define SAMPLES 1000000
+// number of lines for the key/value parsers
+#define KV_LINES 200000
+#define KV_KEYS 5
+// number of frames for the rendering benchmark
+#define FRAMES 2000
+#define PLOT_GRAPHS 4
+#define PLOT_WIDTH 200
+#define PLOT_HEIGHT 50
+// number of graphs and files of the --state benchmark
+#define STATE_GRAPHS 100
+#define STATE_FILES 20
+// number of graphs of the --state benchmark which writes the new values into the file
+#define STATE_MANY 5000
+
+// results are added here, so the compiler can not remove the benchmarked code
+volatile double sink;
+
+/// @return deterministic pseudo random numbers in [0, 1000).
+double
+rnd()
+{
+  static uint32_t x = 12345;
+  x = x * 1103515245u + 12345u;
+  return (x >> 8) % 1000000 / 1000.0;
+}
+
+/**
+ * run @p f RUNS times and print the rate of the best run.
+ * @param n number of items processed by @p f.
+ * @param unit name of the items.
+ */
+void
+bench(const char *name, const size_t n, const char *unit, const std::function<void()> &f)
+{
+  double best = DBL_MAX;
+  for(int i = 0; i < RUNS; ++i)
+  {
+    const auto t0 = std::chrono::steady_clock::now();
+    f();
+    const std::chrono::duration<double> d = std::chrono::steady_clock::now() - t0;
+    best = std::min(best, d.count());
+  }
+  printf("%-32s %14.0f %s/s\n", name, n / best, unit);
+}
+
+/// @return a temporary file with @p s.
+FILE*
+temp_file(const std::string &s)
+{
+  FILE *f = tmpfile();
+  if (! f ||
+      fwrite(s.data(), 1, s.size(), f) != s.size() ||
+      fflush(f) != 0)
+  {
+    perror("tmpfile");
+    exit(EXIT_FAILURE);
+  }
+  return f;
+}
+
+/// parse @p f with input_t and call @p parse for every sample.
+void
+parse_input(FILE *f, const std::function<input_t::result_t(input_t&)> &parse)
+{
+  lseek(fileno(f), 0, SEEK_SET);
+  input_t in;
+  in.fd = fileno(f);
+  while(1)
+  {
+    const auto r = parse(in);
+    if (r == input_t::END)
+      break;
+    if (r == input_t::MORE)
+      in.fill(-1);
+  }
+}
+
+int
+main()
+{
+  // input with one value per line
+  std::string one;
+  for(size_t i = 0; i < SAMPLES; ++i)
+  {
+    char b[32];
+    snprintf(b, sizeof(b), "%.3f\n", rnd());
+    one += b;
+  }
+  FILE *one_f = temp_file(one);
+
+  // input with KV_KEYS key/value pairs per line
+  std::string kv;
+  for(size_t i = 0; i < KV_LINES; ++i)
+  {
+    for(int k = 0; k < KV_KEYS; ++k)
+    {
+      char b[48];
+      snprintf(b, sizeof(b), "%skey%d %.3f", k ? " " : "", k, rnd());
+      kv += b;
+    }
+    kv += '\n';
+  }
+  FILE *kv_f = temp_file(kv);
+
+  printf("%d runs, best run is printed\n", RUNS);
+
+  // the parsers used before input_t
+  bench("scanf", SAMPLES, "samples", [&]() {
+      rewind(one_f);
+      double v, s = 0;
+      while(fscanf(one_f, "%lf", &v) == 1)
+        s += v;
+      sink = s;
+    });
+  bench("input_t::values", SAMPLES, "samples", [&]() {
+      double s = 0;
+      parse_input(one_f, [&](input_t &in) {
+          double v;
+          const auto r = in.values(&v, 1);
+          if (r == input_t::PARSED)
+            s += v;
+          return r;
+        });
+      sink = s;
+    });
+  bench("istringstream key/value", KV_LINES * KV_KEYS, "samples", [&]() {
+      rewind(kv_f);
+      char *line = NULL;
+      size_t cap = 0;
+      double s = 0;
+      while(getline(&line, &cap, kv_f) > 0)
+      {
+        std::istringstream is(line);
+        std::string k;
+        double v;
+        while(is >> k >> v)
+          s += v;
+      }
+      free(line);
+      sink = s;
+    });
+  bench("input_t::key_values", KV_LINES * KV_KEYS, "samples", [&]() {
+      double s = 0;
+      parse_input(kv_f, [&](input_t &in) {
+          return in.key_values([&](const char*, size_t, const double v) {
+              s += v;
+            });
+        });
+      sink = s;
+    });
+
+  // statistics
+  std::vector<double> samples(SAMPLES);
+  for(auto &v : samples)
+    v = rnd();
+  bench("values_t::push_back + update", SAMPLES, "samples", [&]() {
+      values_t vals;
+      vals.init("#");
+      double s = 0;
+      for(size_t i = 0; i < samples.size(); ++i)
+      {
+        vals.push_back(samples[i], i + 1, PLOT_WIDTH - 1, false);
+        vals.update();
+        s += vals.med;
+      }
+      sink = s;
+    });
+
+  // statistics of zoomed out columns, 10% of the values are missing
+  std::vector<double> columns(samples);
+  for(auto &v : columns)
+  {
+    if (rnd() < 100)
+      v = DOUBLE_MISSING;
+  }
+  bench("branching min/max/sum", SAMPLES, "values", [&]() {
+      double mn = 0, mx = 0, s = 0;
+      size_t n = 0;
+      for(const auto v : columns)
+      {
+        if (! values_t::valid(v))
+          continue;
+        if (n++ == 0)
+        {
+          mn = mx = v;
+        }
+        else
+        {
+          mn = std::min(mn, v);
+          mx = std::max(mx, v);
+        }
+        s += v;
+      }
+      sink = mn + mx + s / n;
+    });
+  bench("min/max/sum_valid", SAMPLES, "values", [&]() {
+      double s = 0;
+      const size_t n = sum_valid(columns.data(), columns.size(), s);
+      const double mn = min_valid(columns.data(), columns.size(), INFINITY);
+      const double mx = max_valid(columns.data(), columns.size(), -INFINITY);
+      sink = mn + mx + s / n;
+    });
+
+  // spectrum of -F for a wide plot
+  fft_t fft;
+  fft.init(512);
+  std::vector<double> amp;
+  bench("fft_t::amplitudes 512", SAMPLES / 512, "spectra", [&]() {
+      double s = 0;
+      for(size_t i = 0; i + 512 <= samples.size(); i += 512)
+      {
+        std::copy_n(samples.begin() + i, 512, fft.re.begin());
+        fft.amplitudes(amp);
+        s += amp[1];
+      }
+      sink = s;
+    });
+
+  // --state file of graphs with the values of a full plot and the zoomed out history
+  for(int k = 0; k < STATE_GRAPHS; ++k)
+  {
+    auto &g = values["key" + std::to_string(k)];
+    for(size_t i = 0; i < PLOT_WIDTH * ZOOM_FACTOR * ZOOM_FACTOR; ++i)
+      g.push_back(rnd(), i + 1, PLOT_WIDTH - 1, false);
+  }
+  const std::string state_fn = "/tmp/ttyplot-bench-" + std::to_string(getpid()) + ".state";
+  state_t state;
+  bench("save_state new file", STATE_FILES, "files", [&]() {
+      for(int f = 0; f < STATE_FILES; ++f)
+      {
+        unlink(state_fn.c_str());
+        if (! save_state(state_fn.c_str(), state))
+        {
+          perror(state_fn.c_str());
+          exit(EXIT_FAILURE);
+        }
+      }
+    });
+  bench("load_state", STATE_FILES, "files", [&]() {
+      for(int f = 0; f < STATE_FILES; ++f)
+      {
+        values.clear();
+        if (! load_state(state_fn.c_str(), state))
+        {
+          fprintf(stderr, "%s could not be read\n", state_fn.c_str());
+          exit(EXIT_FAILURE);
+        }
+      }
+      sink = values.size();
+    });
+  // many graphs, whose file is written again or only gets the new values
+  values.clear();
+  for(int k = 0; k < STATE_MANY; ++k)
+  {
+    auto &g = values["key" + std::to_string(k)];
+    for(size_t i = 0; i < PLOT_WIDTH * ZOOM_FACTOR * ZOOM_FACTOR; ++i)
+      g.push_back(rnd(), i + 1, PLOT_WIDTH - 1, false);
+  }
+  bench("save_state 5000 new file", 1, "files", [&]() {
+      unlink(state_fn.c_str());
+      if (! save_state(state_fn.c_str(), state))
+      {
+        perror(state_fn.c_str());
+        exit(EXIT_FAILURE);
+      }
+    });
+  // every graph has a new value in each file, which is written into the mapped file
+  size_t state_gen = PLOT_WIDTH * ZOOM_FACTOR * ZOOM_FACTOR;
+  bench("push_back + save_state 5000", STATE_FILES, "files", [&]() {
+      for(int f = 0; f < STATE_FILES; ++f)
+      {
+        ++state_gen;
+        for(size_t id = 0; id < values.size(); ++id)
+          values[id].push_back(rnd(), state_gen, PLOT_WIDTH - 1, false);
+        if (! save_state(state_fn.c_str(), state))
+        {
+          perror(state_fn.c_str());
+          exit(EXIT_FAILURE);
+        }
+      }
+    });
+  unlink(state_fn.c_str());
+  values.clear();
+
+  // formatting of the values in the labels and details
+  bench("snprintf %.1f", SAMPLES, "values", [&]() {
+      size_t s = 0;
+      for(const auto v : samples)
+      {
+        char b[FORMAT_SIZE];
+        s += snprintf(b, sizeof(b), "%.1f", v);
+      }
+      sink = s;
+    });
+  bench("format_fixed", SAMPLES, "values", [&]() {
+      size_t s = 0;
+      for(const auto v : samples)
+      {
+        char b[FORMAT_SIZE];
+        s += format_fixed(b, v, 1) - b;
+      }
+      sink = s;
+    });
+
+  // rendering into a screen which writes to /dev/null
+  setenv("COLUMNS", std::to_string(PLOT_WIDTH).c_str(), 1);
+  setenv("LINES", std::to_string(PLOT_HEIGHT + PLOT_GRAPHS + 1).c_str(), 1);
+  FILE *null_out = fopen("/dev/null", "w");
+  FILE *null_in = fopen("/dev/null", "r");
+  if (! null_out ||
+      ! null_in)
+  {
+    perror("/dev/null");
+    return EXIT_FAILURE;
+  }
+  // braille patterns are written in UTF-8 if the environment has a UTF-8 locale
+  setlocale(LC_CTYPE, "");
+  sp = newterm("vt100", null_out, null_in);
+  if (! sp)
+  {
+    fprintf(stderr, "could not create a vt100 screen\n");
+    return EXIT_FAILURE;
+  }
+  const int plotwidth = PLOT_WIDTH - 1;
+  fb.resize(PLOT_WIDTH, PLOT_HEIGHT + PLOT_GRAPHS + 1);
+  std::deque<values_t> graphs(PLOT_GRAPHS);
+  size_t gen = 0;
+  for(size_t i = 0; i < graphs.size(); ++i)
+  {
+    graphs[i].init(std::string(1, 'a' + i));
+  }
+  for(; gen < static_cast<size_t>(plotwidth); ++gen)
+  {
+    for(auto &g : graphs)
+      g.push_back(rnd(), gen + 1, plotwidth, false);
+  }
+  bench("values_t::plot + refresh", FRAMES, "frames", [&]() {
+      for(int f = 0; f < FRAMES; ++f)
+      {
+        // every frame adds a value, so the whole plot area changes
+        ++gen;
+        fb.blank();
+        draw_axes(PLOT_HEIGHT, plotwidth);
+        for(auto &g : graphs)
+        {
+          g.push_back(rnd(), gen, plotwidth, false);
+          g.plot(0, SIZE_MAX, PLOT_HEIGHT, 1000, 0, 'e', 'v', DOUBLE_MAX);
+        }
+        fb.flush();
+        refresh();
+      }
+    });
+  // the same plot with the graphs of each column drawn from the highest to the lowest value like -k -b,
+  // only the new column is ranked in each frame
+  bar_order_t bar_order;
+  std::vector<size_t> ids;
+  for(size_t i = 0; i < graphs.size(); ++i)
+    ids.push_back(i);
+  bench("values_t::plot sorted + refresh", FRAMES, "frames", [&]() {
+      for(int f = 0; f < FRAMES; ++f)
+      {
+        ++gen;
+        fb.blank();
+        draw_axes(PLOT_HEIGHT, plotwidth);
+        for(auto &g : graphs)
+          g.push_back(rnd(), gen, plotwidth, false);
+        bar_order.reset(ids, 0);
+        const size_t cols = graphs[0].cols();
+        for(size_t x = 0; x < cols; ++x)
+        {
+          const auto &order = bar_order.order(gen + x - cols, cols, false, [&](const uint32_t idx) {
+              return graphs[idx].bar(x);
+            });
+          for(const auto idx : order)
+            graphs[idx].plot(x, x + 1, PLOT_HEIGHT, 1000, 0, 'e', 'v', DOUBLE_MAX);
+        }
+        fb.flush();
+        refresh();
+      }
+    });
+  // the same plot with 2x4 braille dots in each cell
+  braille_t canvas;
+  bench("values_t::plot braille + refresh", FRAMES, "frames", [&]() {
+      for(int f = 0; f < FRAMES; ++f)
+      {
+        ++gen;
+        fb.blank();
+        draw_axes(PLOT_HEIGHT, plotwidth);
+        canvas.clear(plotwidth, PLOT_HEIGHT);
+        for(auto &g : graphs)
+        {
+          g.push_back(rnd(), gen, plotwidth * BRAILLE_X, false);
+          g.plot(0, SIZE_MAX, PLOT_HEIGHT * BRAILLE_Y, 1000, 0, 'e', 'v', DOUBLE_MAX, [&](const int x, const int y1, const int y2, const int pc) {
+              canvas.line(x, y1, y2, (pc == g.name[0]) ? 0 : pc, 0);
+            });
+        }
+        canvas.draw();
+        fb.flush();
+        refresh();
+      }
+    });
+  endwin();
+  delscreen(sp);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,574 @@
+/** @file
+ * test: unit tests for the parsers, the formatting of labels, the --shm ring, the statistics, the quantiles and the --state file of ttyplot.
+ * Apache License 2.0
+ *
+ * Every failed check is printed, the exit status is the number of failed checks.
+ */
+
+#define TTYPLOT_NO_MAIN
+#include "ttyplot.cpp"
+
+#include <random>
+
+// number of failed checks
+int failed = 0;
+
+#define CHECK(cond) \
+  do { \
+    if (! (cond)) \
+    { \
+      fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+      ++failed; \
+    } \
+  } while(0)
+
+/// an infinite value which leaves the window does not leave a NaN in the sum.
+void
+test_infinite_leaves_window()
+{
+  values_t vals;
+  vals.init("#");
+  const size_t width = 3;
+  size_t gen = 0;
+  vals.push_back(INFINITY, ++gen, width, false);
+  vals.update();
+  CHECK(vals.avg == INFINITY);
+  for(const double v : {1.0, 2.0, 3.0})
+  {
+    vals.push_back(v, ++gen, width, false);
+  }
+  vals.update();
+  CHECK(vals.count == 3);
+  CHECK(vals.sum == 6);
+  CHECK(vals.avg == 2);
+  CHECK(vals.max == 3);
+  CHECK(vals.min == 1);
+  // the sum stays correct when more values leave the window
+  vals.push_back(4, ++gen, width, false);
+  vals.update();
+  CHECK(vals.sum == 9);
+  CHECK(vals.avg == 3);
+}
+
+/// parse_double() returns the same value and end as strtod() for @p s.
+void
+check_parse_double(const char *s)
+{
+  // parse_double() writes after the number, the input buffer has one extra byte
+  std::vector<char> b(s, s + strlen(s) + 1);
+  char *e = b.data() + b.size() - 1;
+  double v = 0;
+  char *end = NULL;
+  const bool ok = parse_double(b.data(), e, v, end);
+  char *ref_end;
+  const double ref = strtod(s, &ref_end);
+  if (ok != (ref_end != s) ||
+      (ok && (end - b.data() != ref_end - s ||
+              (std::isnan(ref) ? ! std::isnan(v) : memcmp(&v, &ref, sizeof(v)) != 0))))
+  {
+    fprintf(stderr, "%s:%d: parse_double(\"%s\") is %.17g, strtod() is %.17g\n", __FILE__, __LINE__, s, v, ref);
+    ++failed;
+  }
+}
+
+/// the numbers parsed without strtod() are the same as the numbers of strtod().
+void
+test_parse_double()
+{
+  for(const char *s : {
+      // signs
+      "0", "-0", "+0", "1", "-1", "+1", "-+1", "+-1", "--1", "-", "+",
+      // fractions
+      "0.5", "-.5", ".5", "5.", ".", "-.", "0.1", "0.3", "123.456", "-123.456", "0000.0001",
+      // exponents
+      "1e0", "1e22", "1e23", "1e-22", "1e-23", "1E5", "1e+5", "-1e-5", "1.5e3", ".5e-2",
+      "1e308", "1e309", "-1e309", "4.9e-324", "2.5e-324", "1e-400", "1e99999999999",
+      "123456789012345e-22", "123456789012345e22", "0.000000000000000000000001",
+      // rounding at the edge of double precision, 15 digits use the fast path
+      "999999999999999", "9999999999999999", "9007199254740992", "9007199254740993",
+      "9007199254740995", "0.999999999999999", "0.9999999999999999", "1.7976931348623157e308",
+      "2.2250738585072014e-308", "0.30000000000000004", "4503599627370497.5",
+      // overlong mantissas
+      "123456789012345678901234567890", "1.23456789012345678901234567890",
+      "0.000000000000000000000000000000123456789012345678901234567890e30",
+      "100000000000000000000000000000000000000000000000000000000000000000000000000000000000",
+      "1.000000000000000000000000000000000000000000000000000000000000000000000001",
+      // inf, nan and hex
+      "inf", "-inf", "INF", "infinity", "-Infinity", "nan", "-nan", "NaN", "nan(123)",
+      "0x10", "-0x1p3", "0x", "0xg",
+      // trailing garbage
+      "12abc", "1.5.5", "1e", "1e+", "1e-x", "1ee5", "3.14,", "-5%", "7:8", "1x2", "abc", "e5", ""
+    })
+  {
+    check_parse_double(s);
+  }
+}
+
+/// format_fixed() writes the same string as snprintf("%.*f") for @p d.
+void
+check_format_fixed(const double d, const int decimals)
+{
+  char buf[FORMAT_SIZE], ref[FORMAT_SIZE];
+  const char *e = format_fixed(buf, d, decimals);
+  snprintf(ref, sizeof(ref), "%.*f", decimals, d);
+  if (strcmp(buf, ref) != 0 ||
+      e != buf + strlen(buf))
+  {
+    fprintf(stderr, "%s:%d: format_fixed(%.17g, %d) is \"%s\", snprintf() is \"%s\"\n", __FILE__, __LINE__, d, decimals, buf, ref);
+    ++failed;
+  }
+}
+
+/// the labels are formatted like with snprintf().
+void
+test_format_fixed()
+{
+  for(const double d : {
+      0.0, -0.0, 1.0, -1.0, 0.1, 0.5, 1.5, 2.5, -2.5, 0.125, 0.375,
+      // rounding carries
+      9.995, 9.9951, 9.999, 9.9999, 99.995, 999.9995, 0.995, 0.0005, 0.00049, 0.045, 1.005, 2.675,
+      -9.995, -9.9999, -0.0001, -0.004, -0.005, -0.006, -0.5, -0.05, -0.0005,
+      // very large and very small values
+      123456789.123, 999999999999.9995, 1e14, 1e15 - 0.5, 1e15, 1e16, 4503599627370495.5, 1e20, 1e300, -1e300,
+      DBL_MAX, -DBL_MAX, 1e-5, 1e-300, DBL_MIN, 5e-324, -5e-324,
+      // not finite
+      double(NAN), -double(NAN), double(INFINITY), -double(INFINITY)
+    })
+  {
+    for(int decimals = 0; decimals <= 3; ++decimals)
+    {
+      check_format_fixed(d, decimals);
+    }
+  }
+  // values of the labels
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<double> u(-1000, 1000);
+  for(size_t i = 0; i < 100000; ++i)
+  {
+    const double d = u(rng) * pow(10, static_cast<int>(i % 12) - 6);
+    check_format_fixed(d, i % 4);
+  }
+  // printValue() removes trailing zeros
+  char buf[FORMAT_SIZE];
+  CHECK(strcmp(printValue(buf, 9.995), "9.99") == 0);
+  CHECK(strcmp(printValue(buf, 9.9951), "10") == 0);
+  CHECK(strcmp(printValue(buf, -1.5), "-1.5") == 0);
+  CHECK(strcmp(printValue(buf, 0.001), "0") == 0);
+}
+
+/// @return @p v as a little endian 16 bit number.
+std::string
+le16(const uint16_t v)
+{
+  return std::string{static_cast<char>(v & 0xff), static_cast<char>(v >> 8)};
+}
+
+/// @return @p v as a little endian float64.
+std::string
+le_double(const double v)
+{
+  char b[sizeof(v)];
+  memcpy(b, &v, sizeof(v));
+  return std::string(b, sizeof(v));
+}
+
+/// @return a key frame of the binary format which defines the key id @p id.
+std::string
+key_frame(const uint16_t id, const std::string &key)
+{
+  return "k" + le16(id) + static_cast<char>(key.size()) + key;
+}
+
+/// @return a sample frame of the binary format without a timestamp.
+std::string
+sample_frame(const std::vector<std::pair<uint16_t, double>> &records)
+{
+  std::string s = "s" + le16(records.size());
+  for(const auto &r : records)
+  {
+    s += le16(r.first) + le_double(r.second);
+  }
+  return s;
+}
+
+/// binary key/value frames are parsed from a pipe.
+void
+test_binary_key_values()
+{
+  int fds[2];
+  CHECK(pipe(fds) == 0);
+  source_t src;
+  src.input.fd = fds[0];
+  // the keys which were passed to the main thread and the values of the last sample
+  std::vector<std::string> keys;
+  std::vector<std::pair<size_t, double>> vals;
+  auto k = [&](const char *key, const size_t klen) {
+    keys.emplace_back(key, klen);
+    return keys.size() - 1;
+  };
+  auto f = [&](const size_t id, const double v) {
+    vals.emplace_back(id, v);
+  };
+  auto send = [&](const std::string &s) {
+    CHECK(write(fds[1], s.data(), s.size()) == static_cast<ssize_t>(s.size()));
+    CHECK(src.input.append());
+  };
+  const size_t invalid = metrics.invalid;
+
+  // a frame split across reads is parsed when it is complete
+  const std::string frames = key_frame(7, "cpu") + sample_frame({{7, 1.5}});
+  for(size_t i = 0; i + 1 < frames.size(); ++i)
+  {
+    send(frames.substr(i, 1));
+    CHECK(src.binary_key_values(k, f, NULL) == input_t::MORE);
+  }
+  send(frames.substr(frames.size() - 1));
+  CHECK(src.binary_key_values(k, f, NULL) == input_t::PARSED);
+  CHECK(keys.size() == 1 && keys[0] == "cpu");
+  CHECK(vals.size() == 1 && vals[0].first == 0 && vals[0].second == 1.5);
+  CHECK(src.binary_id(7) == 0);
+  CHECK(metrics.invalid == invalid);
+
+  // a value of an unknown key id is skipped
+  vals.clear();
+  send(sample_frame({{8, 2}, {7, 3}, {1000, 4}}));
+  CHECK(src.binary_key_values(k, f, NULL) == input_t::PARSED);
+  CHECK(vals.size() == 1 && vals[0].first == 0 && vals[0].second == 3);
+  CHECK(metrics.invalid == invalid + 2);
+
+  // an empty key does not define the key id
+  vals.clear();
+  send(key_frame(8, "") + sample_frame({{8, 5}}));
+  CHECK(src.binary_key_values(k, f, NULL) == input_t::PARSED);
+  CHECK(keys.size() == 1);
+  CHECK(vals.empty());
+  CHECK(src.binary_id(8) == values_table_t::npos);
+  CHECK(metrics.invalid == invalid + 4);
+
+  // a bad frame type skips one byte, the next frame is parsed
+  vals.clear();
+  send("x" + sample_frame({{7, 6}}));
+  CHECK(src.binary_key_values(k, f, NULL) == input_t::INVALID);
+  CHECK(metrics.invalid == invalid + 5);
+  CHECK(src.binary_key_values(k, f, NULL) == input_t::PARSED);
+  CHECK(vals.size() == 1 && vals[0].second == 6);
+
+  // a frame cut off by the end of input is invalid
+  send(sample_frame({{7, 7}}).substr(0, 5));
+  close(fds[1]);
+  CHECK(src.input.append());
+  CHECK(src.binary_key_values(k, f, NULL) == input_t::END);
+  CHECK(metrics.invalid == invalid + 6);
+  close(fds[0]);
+}
+
+/// the reader of a --shm ring continues at the start of a sample after the ring was overwritten.
+void
+test_shm_overrun()
+{
+  const std::string name = "/ttyplot-test-" + std::to_string(getpid());
+  ttyplot_shm *shm = ttyplot_shm_create(name.c_str());
+  CHECK(shm != NULL);
+  if (! shm)
+    return;
+  source_t src;
+  src.kind = source_t::SHM;
+  src.shm = shm;
+  // the keys which were passed to the main thread, the values and the timestamp of the last sample
+  std::vector<std::string> keys;
+  std::vector<std::pair<uint32_t, double>> vals;
+  double ts = -1;
+  auto k = [&](const char *key, const size_t klen) {
+    keys.emplace_back(key, klen);
+    return keys.size() - 1;
+  };
+  auto f = [&](const uint32_t key, const double v, const double *t) {
+    const size_t id = src.binary_id(key);
+    if (id == values_table_t::npos)
+      return false;
+    if (vals.empty())
+    {
+      ts = t ? *t : -1;
+    }
+    vals.emplace_back(id, v);
+    return true;
+  };
+  auto drop = [&]() {
+    vals.clear();
+  };
+  const size_t dropped = metrics.dropped;
+  const size_t invalid = metrics.invalid;
+
+  const uint32_t a = ttyplot_shm_key(shm, "a");
+  const uint32_t b = ttyplot_shm_key(shm, "b");
+  const uint32_t c = ttyplot_shm_key(shm, "c");
+  CHECK(ttyplot_shm_key(shm, "") == TTYPLOT_SHM_NOKEY);
+  // a producer which does not use ttyplot_shm_key() wrote an empty key
+  const uint32_t empty = shm->nkeys;
+  shm->key[empty][0] = 0;
+  __atomic_store_n(&shm->nkeys, empty + 1, __ATOMIC_RELEASE);
+  ttyplot_shm_value(shm, empty, 1);
+  ttyplot_shm_value(shm, a, 2);
+  ttyplot_shm_commit(shm);
+  CHECK(src.shm_values(k, f, drop) == input_t::PARSED);
+  CHECK(keys.size() == 3);
+  CHECK(src.binary_id(empty) == values_table_t::npos);
+  CHECK(vals.size() == 1 && vals[0].first == 0 && vals[0].second == 2);
+  CHECK(metrics.invalid == invalid + 1);
+  vals.clear();
+  CHECK(src.shm_values(k, f, drop) == input_t::MORE);
+  CHECK(vals.empty());
+
+  // samples of a timestamp and 3 values wrap the ring, which is not a multiple of 4 slots
+  const size_t n = TTYPLOT_SHM_SLOTS / 4 + 1000;
+  for(size_t i = 1; i <= n; ++i)
+  {
+    ttyplot_shm_time(shm, i);
+    ttyplot_shm_value(shm, a, i);
+    ttyplot_shm_value(shm, b, i);
+    ttyplot_shm_value(shm, c, i);
+    ttyplot_shm_commit(shm);
+    if (i == n / 2)
+    {
+      // a slot which is not the first slot of a sample
+      ttyplot_shm_value(shm, a, 0);
+    }
+  }
+  // a sample which is not committed yet
+  ttyplot_shm_value(shm, a, -1);
+  CHECK(src.shm_values(k, f, drop) == input_t::PARSED);
+  CHECK(metrics.dropped == dropped + 1);
+  CHECK(ts == n);
+  CHECK(vals.size() == 3);
+  for(size_t i = 0; i < vals.size(); ++i)
+  {
+    CHECK(vals[i].first == i && vals[i].second == n);
+  }
+  vals.clear();
+  CHECK(src.shm_values(k, f, drop) == input_t::MORE);
+  CHECK(vals.empty());
+
+  // the reader continues with the next sample
+  ttyplot_shm_commit(shm);
+  CHECK(src.shm_values(k, f, drop) == input_t::PARSED);
+  CHECK(vals.size() == 1 && vals[0].first == 0 && vals[0].second == -1);
+  CHECK(ts == -1);
+  CHECK(metrics.dropped == dropped + 1);
+  munmap(shm, sizeof(*shm));
+  shm_unlink(name.c_str());
+}
+
+/// the quantiles of sketch_t are within the relative error SKETCH_ALPHA of the exact quantiles.
+void
+test_sketch()
+{
+  std::mt19937 rng(42);
+  std::lognormal_distribution<double> mag(0, 3);
+  std::uniform_real_distribution<double> u(0, 1);
+  // positive values, mixed signs with zeros, and negative values
+  for(const double neg_share : {0.0, 0.4, 1.0})
+  {
+    sketch_t s;
+    std::vector<double> v;
+    for(size_t i = 0; i < 100000; ++i)
+    {
+      const double r = u(rng);
+      double x = std::min(std::max(mag(rng), 1e-3), 1e5);
+      if (neg_share > 0 && neg_share < 1 && r < 0.1)
+        x = 0;
+      else if (r < neg_share)
+        x = -x;
+      s.add(x);
+      v.push_back(x);
+    }
+    // values which are not finite are ignored
+    s.add(NAN);
+    s.add(INFINITY);
+    for(const double q : {0.0, 0.01, 0.25, 0.5, 0.9, 0.99, 1.0})
+    {
+      const size_t rank = static_cast<size_t>(q * (v.size() - 1) + 0.5);
+      std::nth_element(v.begin(), v.begin() + rank, v.end());
+      const double exact = v[rank];
+      const double approx = s.quantile(q);
+      if (fabs(approx - exact) > SKETCH_ALPHA * fabs(exact) * (1 + 1e-9))
+      {
+        fprintf(stderr, "%s:%d: quantile %g of sketch is %g, exact %g\n", __FILE__, __LINE__, q, approx, exact);
+        ++failed;
+      }
+    }
+  }
+  // the quantile of zeros is 0
+  sketch_t z;
+  CHECK(z.quantile(0.5) == 0);
+  z.add(0);
+  z.add(-0.0);
+  z.add(0);
+  CHECK(z.quantile(0.5) == 0);
+  CHECK(z.quantile(0.99) == 0);
+}
+
+/// @return the name of a temporary --state file.
+std::string
+state_name()
+{
+  return "/tmp/ttyplot-test-" + std::to_string(getpid()) + ".state";
+}
+
+/// graphs are restored from a --state file.
+void
+test_state()
+{
+  const std::string fn = state_name();
+  values.clear();
+  for(size_t gen = 1; gen <= 100; ++gen)
+  {
+    values["a"].push_back(gen, gen, 50, false);
+    values["b"].push_back(-1.0 * gen, gen, 50, false);
+  }
+  // vec keeps more values than the window
+  const size_t kept = values["a"].vec.size();
+  state_t s;
+  s.gen = 100;
+  CHECK(save_state(fn.c_str(), s));
+
+  values.clear();
+  state_t r;
+  CHECK(load_state(fn.c_str(), r));
+  CHECK(r.gen == 100);
+  CHECK(values.size() == 2);
+  auto &a = values["a"];
+  a.update();
+  CHECK(a.vec.size() == kept);
+  CHECK(a.vec.back() == 100);
+  CHECK(a.count == 50);
+  CHECK(a.max == 100);
+  CHECK(a.min == 51);
+  unlink(fn.c_str());
+  values.clear();
+}
+
+/// @return the bytes of the values and the columns of all tiers of graph @p k,
+/// so padding NaN values compare equal.
+static std::string
+history(const char *k)
+{
+  std::string h;
+  const auto add = [&h](const double v) {
+    h.append(reinterpret_cast<const char*>(&v), sizeof(v));
+  };
+  const auto &val = values[k];
+  for(size_t i = 0; i < val.vec.size(); ++i)
+    add(val.vec[i]);
+  for(const auto &t : val.tiers)
+  {
+    add(t.next);
+    for(size_t c = 0; c < t.avg.size(); ++c)
+      add(t.avg[c]);
+  }
+  return h;
+}
+
+/// --state writes new values into the records of the mapped file, a graph whose capacity
+/// grew is moved to a new record.
+void
+test_incremental_state()
+{
+  const std::string fn = state_name();
+  values.clear();
+  state_t s;
+  size_t gen = 1;
+  for(; gen <= 100; ++gen)
+    values["a"].push_back(gen, gen, 50, false);
+  CHECK(save_state(fn.c_str(), s));
+  struct stat st1;
+  CHECK(stat(fn.c_str(), &st1) == 0);
+
+  for(; gen <= 130; ++gen)
+  {
+    values["a"].push_back(gen, gen, 50, false);
+    values["b"].push_back(-1.0 * gen, gen, 50, false);
+  }
+  CHECK(save_state(fn.c_str(), s));
+  for(; gen <= 1002; ++gen)
+    values["a"].push_back(gen, gen, 300, false);
+  CHECK(save_state(fn.c_str(), s));
+  // the last columns of the tiers are not complete
+  for(; gen <= 1010; ++gen)
+  {
+    values["a"].push_back(gen, gen, 300, false);
+    values["b"].push_back(-1.0 * gen, gen, 50, false);
+  }
+  s.gen = gen - 1;
+  CHECK(save_state(fn.c_str(), s));
+  // the file was not written again
+  struct stat st2;
+  CHECK(stat(fn.c_str(), &st2) == 0);
+  CHECK(st1.st_ino == st2.st_ino);
+  CHECK(state_map.unused > 0);
+
+  const auto a = history("a");
+  const auto b = history("b");
+  values.clear();
+  state_t r;
+  CHECK(load_state(fn.c_str(), r));
+  CHECK(r.gen == 1010);
+  CHECK(values.size() == 2);
+  CHECK(history("a") == a);
+  CHECK(history("b") == b);
+  unlink(fn.c_str());
+  values.clear();
+}
+
+/// a damaged --state file does not leave graphs behind which are not part of the options.
+void
+test_damaged_state()
+{
+  const std::string fn = state_name();
+  values.clear();
+  for(const char *k : {"a", "b", "c"})
+  {
+    values[k].push_back(1, 1, 50, false);
+  }
+  state_t s;
+  CHECK(save_state(fn.c_str(), s));
+  // the file ends in the middle of graph c
+  struct stat st;
+  CHECK(stat(fn.c_str(), &st) == 0);
+  CHECK(truncate(fn.c_str(), st.st_size - 4) == 0);
+
+  values.clear();
+  values["a"];
+  state_t r;
+  CHECK(! load_state(fn.c_str(), r));
+  CHECK(errno == 0);
+  CHECK(values.size() == 1);
+  CHECK(values.find("a", 1) == 0);
+  CHECK(values.find("b", 1) == values_table_t::npos);
+  CHECK(values.find("c", 1) == values_table_t::npos);
+  CHECK(values.sorted().size() == 1);
+  CHECK(values[0].vec.empty());
+  // the table works after the graphs were removed
+  CHECK(values.id("c", 1) == 1);
+  CHECK(values.find("c", 1) == 1);
+  unlink(fn.c_str());
+  values.clear();
+}
+
+int
+main()
+{
+  test_parse_double();
+  test_format_fixed();
+  test_binary_key_values();
+  test_shm_overrun();
+  test_sketch();
+  test_infinite_leaves_window();
+  test_state();
+  test_incremental_state();
+  test_damaged_state();
+  if (failed)
+  {
+    fprintf(stderr, "%d checks failed\n", failed);
+  }
+  return failed;
+}
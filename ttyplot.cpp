@@ -14,29 +14,57 @@
 #include <time.h>
 #include <curses.h>
 #include <signal.h>
-#include <sys/time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
 #include <execinfo.h>
+#include <poll.h>
+#include <errno.h>
+#include <getopt.h>
+#include <locale.h>
+#include <langinfo.h>
+#include <termios.h>
 
 #ifdef __OpenBSD__
 #include <err.h>
 #endif
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 #include <utility>
+#include <cstdint>
 #include <cassert>
 #include <climits>
-#include <map>
 #include <string>
+#include <set>
 #include <deque>
-#include <iostream>
+#include <list>
+#include <cmath>
 #include <sstream>
 #include <vector>
 #include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "ttyplot_shm.h"
 
 #define verstring "github.com/doj/ttyplot"
 
 #define DOUBLE_MIN (-FLT_MAX)
 #define DOUBLE_MAX FLT_MAX
 #define DOUBLE_UNINIT DOUBLE_MIN
+// missing values of the graphs. NaN is skipped by the statistics kernels without a branch.
+#define DOUBLE_MISSING NAN
 
 #define INT_UNINIT INT_MIN
 
@@ -44,6 +72,50 @@
 
 #define SCREENWIDTH_FOR_2COLUMN 140
 
+// maximum time in milliseconds to parse available input before the screen is redrawn
+#define DRAIN_MS 100
+
+// with --headless the statistics are calculated like for a plot with this many columns
+#define HEADLESS_WIDTH 1000
+
+// number of zoom levels, each level aggregates ZOOM_FACTOR columns of the previous level
+#define ZOOM_LEVELS 3
+#define ZOOM_FACTOR 10
+
+// with --autoscale the scale is this fraction of the visible range larger than the values
+#define AUTOSCALE_HEADROOM 0.1
+// with --autoscale the scale shrinks if more than this fraction of it is not used
+#define AUTOSCALE_SHRINK 0.5
+
+// number of frames used for the frame time statistics of the status line
+#define FRAME_TIMES 256
+
+// relative accuracy of the quantiles of all samples
+#define SKETCH_ALPHA 0.01
+// maximum number of bins of positive and of negative values in a sketch
+#define SKETCH_BINS 1024
+// values closer to 0 are counted as 0 by the sketch
+#define SKETCH_MIN 1e-9
+
+// number of records in the queue from the reader thread to the main thread
+#define QUEUE_SIZE 65536
+// number of records after which the reader thread passes the complete samples to the main thread
+#define QUEUE_BATCH 256
+
+// maximum number of records in a sample frame of the binary key/value format,
+// so a frame always fits into the input buffer
+#define BINARY_RECORDS 16384
+// interval in milliseconds in which the reader thread checks a --shm ring for new samples
+#define SHM_POLL_MS 10
+
+// interval in milliseconds in which the graphs are written to the --state file
+#define STATE_MS 5000
+// "TTST" and the version of the --state file format
+#define STATE_MAGIC 0x54535454u
+#define STATE_VERSION 2
+// maximum number of values in a ring of a --state file, a larger ring means the file is damaged
+#define STATE_MAX_VALUES (1u << 20)
+
 #ifdef NOACS
 #define T_HLINE '-'
 #define T_VLINE '|'
@@ -52,12 +124,13 @@
 #define T_LLCR 'L'
 #define T_BLOCK '#'
 #else
-#define T_HLINE ACS_HLINE
-#define T_VLINE ACS_VLINE
-#define T_RARR ACS_RARROW
-#define T_UARR ACS_UARROW
-#define T_LLCR ACS_LLCORNER
-#define T_BLOCK ACS_BLOCK
+// without a curses screen (--ansi) the lines are drawn with the VT100 line drawing characters
+#define T_HLINE (sp ? ACS_HLINE : 'q' | A_ALTCHARSET)
+#define T_VLINE (sp ? ACS_VLINE : 'x' | A_ALTCHARSET)
+#define T_RARR (sp ? ACS_RARROW : '>')
+#define T_UARR (sp ? ACS_UARROW : '^')
+#define T_LLCR (sp ? ACS_LLCORNER : 'm' | A_ALTCHARSET)
+#define T_BLOCK (sp ? ACS_BLOCK : '0' | A_ALTCHARSET)
 #endif
 
 const char *debug_fn = "/tmp/ttyplot.txt";
@@ -65,27 +138,64 @@ const char *debug_fn = "/tmp/ttyplot.txt";
 void
 debug(const char *fmt, ...)
 {
-  auto f = fopen(debug_fn, "a");
+  // the file is opened once and kept open
+  static FILE *f = fopen(debug_fn, "a");
   if (! f)
     return;
   va_list ap;
   va_start(ap, fmt);
   vfprintf(f, fmt, ap);
   va_end(ap);
-  fclose(f);
+  fflush(f);
+}
+
+/// @return number of microseconds of a monotonic clock,
+/// which does not jump if the system time is changed.
+size_t
+getus()
+{
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+    return 0;
+  size_t us = ts.tv_sec;
+  us *= 1000000u;
+  us += ts.tv_nsec / 1000u;
+  return us;
+}
+
+/// @return number of milliseconds of a monotonic clock.
+size_t
+getms()
+{
+  return getus() / 1000u;
+}
+
+/// @return seconds since the epoch.
+double
+gettime()
+{
+  struct timespec ts;
+  if (clock_gettime(CLOCK_REALTIME, &ts) != 0)
+    return 0;
+  return ts.tv_sec + ts.tv_nsec / 1e9;
 }
 
 /* global because we need it accessible in the signal handler */
 SCREEN *sp;
+// foreground colors of the color pairs of -C, which are used without curses by --ansi
+std::vector<short> pair_colors;
+// if true print the metrics when ttyplot exits
+bool print_stats = false;
 
 void
 usage()
 {
-  printf("Usage: ttyplot [-2] [-k] [-r] [-b] [-c char] [-e char] [-E char] [-s scale] [-S scale] [-m max] [-M min] [-t title] [-u unit] [-C 'col1 col2 ...']\n\n"
+  printf("Usage: ttyplot [-2] [-k] [-r] [-b] [-F] [-c char] [-e char] [-E char] [-s scale] [-S scale] [-m max] [-M min] [-t title] [-u unit] [-C 'col1 col2 ...'] [--fps N] [--bucket MS] [--stats] [--overflow drop|coalesce|block] [--timestamps] [--replay FILE] [--speed Nx|max] [--binary] [--fifo PATH] [--udp [ADDR:]PORT] [--unix PATH] [--shm NAME] [--quantiles P,P,...] [--autoscale] [--top N] [--top-by last|avg|max] [--headless csv|json] [--braille] [--ansi] [--waterfall] [--fft-every K] [--state FILE]\n\n"
          "  -2 read two values and draw two plots\n"
          "  -k key/value mode\n"
          "  -r rate mode (divide value by measured sample interval)\n"
-         "  -b draw bar charts, should be set before -2\n"
+         "  -b draw bar charts, should be set before -2. With -k the bars of each column are drawn from the highest to the lowest value\n"
+         "  -F plot the amplitude spectrum of the last values of each graph, the x axis shows the period T in values\n"
          "  -c character(s) for the graph, not used with key/value mode, should be set after -2\n"
          "  -e character to use for error line when value exceeds hardmax, default: 'e'\n"
          "  -E character to use for error symbol displayed when value is less than hardmin, default: 'v'\n"
@@ -96,58 +206,540 @@ usage()
          "  -t title of the plot\n"
          "  -u unit displayed on vertical bar\n"
          "  -C set list of colors: black,blk,bk  red,rd  green,grn,gr  yellow,yel,yl  blue,blu,bl  magenta,mag,mg  cyan,cya,cy,cn  white,wht,wh\n"
+         "  --fps N redraw the screen at most N times per second, input is read as fast as it arrives\n"
+         "  --bucket MS aggregate the samples of MS milliseconds into one column, the minimum and maximum of each column is drawn\n"
+         "  --stats print the number of samples, frame times and input backlog to stderr when ttyplot exits\n"
+         "  --overflow drop|coalesce|block if the input is read faster than it is drawn, drop new samples, keep only the latest value of each graph, or block the input (default)\n"
+         "  --timestamps every sample or line starts with a timestamp in seconds, which is used in rate mode\n"
+         "  --replay FILE read a recorded file instead of stdin, the plot is shown until 'q' is pressed\n"
+         "  --speed Nx|max replay N times faster than the timestamps, or draw only the end of the file (default)\n"
+         "  --binary read little endian float64 values, with -k read key and sample frames, see the README\n"
+         "  --fifo PATH also read the named pipe PATH, can be used several times\n"
+         "  --udp [ADDR:]PORT also read statsd lines key:value|type from a UDP port, default ADDR is 127.0.0.1, requires -k\n"
+         "  --unix PATH also accept connections on the Unix socket PATH\n"
+         "  --shm NAME  also read the samples of a producer from the POSIX shared memory ring NAME, see ttyplot_shm.h\n"
+         "  --quantiles P,P,... show the percentiles P instead of the median, for example 50,95,99\n"
+         "  --autoscale the scale follows the visible values, by default it only grows\n"
+         "  --top N     only plot the N graphs with the largest --top-by values\n"
+         "  --top-by last|avg|max rank the graphs for --top by the last value, the average or the maximum (default max)\n"
+         "  --headless csv|json write the statistics to stdout once per second or --fps N times per second instead of plotting them\n"
+         "  --braille   draw the graphs with braille dots, 2 values and 4 rows in each character. Requires a UTF-8 locale\n"
+         "  --ansi      write VT100 escape sequences of the changed cells without ncurses, one write() per frame\n"
+         "  --waterfall plot the history of the spectrum of the first graph, the newest spectrum is in the top row\n"
+         "  --fft-every K calculate the spectrum of -F every K values, default is a quarter of the FFT size\n"
+         "  --state FILE restore the graphs from FILE when ttyplot starts and write them to FILE every 5 seconds and when it exits\n"
+         "\nkeys: '-' zoom out to 10 or 100 samples per column, '+' zoom in, 's' toggle the status line, 'a' toggle the quantiles of all samples, PgUp/PgDn page through the details, 'q' quit after --replay\n"
          "\nfor more information visit https://%s\n", verstring
          );
   exit(EXIT_FAILURE);
 }
 
+/**
+ * cells of the screen. A frame is drawn into the cells with plain loops and
+ * copied to the curses screen by flush() with one call for each row.
+ * Drawing outside of the screen is ignored, text is cut at the end of the row.
+ */
+struct framebuffer_t
+{
+  int width = 0;
+  int height = 0;
+  // character and attributes of each cell
+  std::vector<chtype> cells;
+  // braille pattern bits of each cell, a cell with dots shows the pattern instead of its character
+  std::vector<uint8_t> dots;
+  // attributes of the drawn characters, like attron()
+  int attr = A_NORMAL;
+
+  /// set the size of the screen, the cells are cleared if it changes.
+  void resize(const int w, const int h)
+  {
+    if (w == width &&
+        h == height)
+      return;
+    width = w;
+    height = h;
+    cells.assign(w * h, ' ');
+    dots.assign(w * h, 0);
+  }
+
+  void blank()
+  {
+    std::fill(cells.begin(), cells.end(), ' ');
+    std::fill(dots.begin(), dots.end(), 0);
+  }
+
+  bool inside(const int y, const int x) const
+  {
+    return y >= 0 && y < height && x >= 0 && x < width;
+  }
+
+  void put(const int y, const int x, const chtype ch)
+  {
+    if (! inside(y, x))
+      return;
+    const size_t i = y * width + x;
+    cells[i] = ch | attr;
+    dots[i] = 0;
+  }
+
+  /// set the attributes of the cell at @p y, @p x to @p a, like mvchgat().
+  void set_attr(const int y, const int x, const int a)
+  {
+    if (! inside(y, x))
+      return;
+    chtype &c = cells[y * width + x];
+    c = (c & A_CHARTEXT) | a;
+  }
+
+  /// draw @p n characters @p ch down from @p y, @p x.
+  void vertical(int y, const int x, const chtype ch, int n)
+  {
+    if (x < 0 ||
+        x >= width)
+      return;
+    if (y < 0)
+    {
+      n += y;
+      y = 0;
+    }
+    n = std::min(n, height - y);
+    const chtype c = ch | attr;
+    for(size_t i = y * width + x; n > 0; --n, i += width)
+    {
+      cells[i] = c;
+      dots[i] = 0;
+    }
+  }
+
+  /// draw @p n characters @p ch right from @p y, @p x.
+  void horizontal(const int y, int x, const chtype ch, int n)
+  {
+    if (y < 0 ||
+        y >= height)
+      return;
+    if (x < 0)
+    {
+      n += x;
+      x = 0;
+    }
+    n = std::min(n, width - x);
+    if (n <= 0)
+      return;
+    const size_t i = y * width + x;
+    std::fill_n(cells.begin() + i, n, ch | attr);
+    std::fill_n(dots.begin() + i, n, 0);
+  }
+
+  /**
+   * draw at most @p n characters of @p s at @p y, @p x.
+   * @return the column after the string.
+   */
+  int text(const int y, int x, const char *s, size_t n = SIZE_MAX)
+  {
+    if (! inside(y, x))
+      return x;
+    size_t i = y * width + x;
+    for(; x < width && n > 0 && *s; ++x, ++i, ++s, --n)
+    {
+      cells[i] = static_cast<unsigned char>(*s) | attr;
+      dots[i] = 0;
+    }
+    return x;
+  }
+
+  /// draw formatted text like mvprintw().
+  /// @return the column after the text.
+  int print(const int y, const int x, const char *fmt, ...) __attribute__((format(printf, 4, 5)))
+  {
+    char s[512];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(s, sizeof(s), fmt, ap);
+    va_end(ap);
+    return text(y, x, s);
+  }
+
+  /// move the columns [1 + n, 1 + w) of the rows [0, h) @p n columns to the left.
+  void shift(const int h, const int w, const int n)
+  {
+    const int len = std::min(w, width - 1) - n;
+    if (n <= 0 ||
+        len <= 0)
+      return;
+    for(int y = 0; y < std::min(h, height); ++y)
+    {
+      const size_t i = y * width;
+      memmove(&cells[i + 1], &cells[i + 1 + n], len * sizeof(chtype));
+      memmove(&dots[i + 1], &dots[i + 1 + n], len);
+    }
+  }
+
+  /// copy the cells to the curses screen.
+  void flush() const
+  {
+    // cells of all braille patterns, the attributes of a cell are applied with attrset()
+    static cchar_t glyphs[256];
+    static bool init = false;
+    if (! init)
+    {
+      for(int m = 0; m < 256; ++m)
+      {
+        const wchar_t w[2] = {static_cast<wchar_t>(0x2800 + m), 0};
+        setcchar(&glyphs[m], w, A_NORMAL, 0, NULL);
+      }
+      init = true;
+    }
+    for(int y = 0; y < height; ++y)
+    {
+      const size_t i = y * width;
+      const chtype *row = &cells[i];
+      if (std::find_if(dots.begin() + i, dots.begin() + i + width, [](const uint8_t d) { return d != 0; }) == dots.begin() + i + width)
+      {
+        mvaddchnstr(y, 0, row, width);
+        continue;
+      }
+      // runs of characters between the braille patterns
+      int x = 0;
+      while(x < width)
+      {
+        int e = x;
+        while(e < width && ! dots[i + e])
+          ++e;
+        if (e > x)
+        {
+          mvaddchnstr(y, x, row + x, e - x);
+        }
+        if (e == width)
+          break;
+        attrset(row[e] & A_ATTRIBUTES);
+        mvadd_wch(y, e, &glyphs[dots[i + e]]);
+        x = e + 1;
+      }
+    }
+    attrset(A_NORMAL);
+  }
+};
+
+// frame which is drawn
+framebuffer_t fb;
+
+// number of unchanged cells in a row which --ansi skips with a cursor movement
+#define ANSI_SKIP 8
+
+/**
+ * terminal output of --ansi, which writes VT100 escape sequences without curses.
+ * Only the cells which changed since the previous frame are written,
+ * the output of a frame is written with one write() call.
+ */
+struct ansi_t
+{
+  // terminal from which keys are read and its settings before begin()
+  int tty = -1;
+  struct termios saved;
+  // cells and braille bits on the terminal
+  std::vector<chtype> cells;
+  std::vector<uint8_t> dots;
+  int width = 0;
+  int height = 0;
+  // output of a frame
+  std::string out;
+  // bytes read from tty which are not returned by key() yet
+  std::string in;
+  // true between begin() and end()
+  bool active = false;
+
+  /// switch to the alternate screen and read keys from @p tty_fd without echo, if it is not -1.
+  void begin(const int tty_fd)
+  {
+    tty = tty_fd;
+    if (tty >= 0 &&
+        tcgetattr(tty, &saved) == 0)
+    {
+      struct termios t = saved;
+      t.c_lflag &= ~(ICANON | ECHO);
+      t.c_cc[VMIN] = 0;
+      t.c_cc[VTIME] = 0;
+      tcsetattr(tty, TCSANOW, &t);
+    }
+    else
+    {
+      tty = -1;
+    }
+    out = "\033[?1049h\033[?25l\033[H\033[2J";
+    send();
+    active = true;
+  }
+
+  /// restore the terminal. Called by the signal handlers, too.
+  void end()
+  {
+    if (! active)
+      return;
+    active = false;
+    out = "\033[0m\033[?25h\033[?1049l";
+    send();
+    if (tty >= 0)
+    {
+      tcsetattr(tty, TCSANOW, &saved);
+    }
+  }
+
+  /// get the size of the terminal, or of $COLUMNS and $LINES if stdout is not a terminal.
+  void size(int &w, int &h) const
+  {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 &&
+        ws.ws_col > 0 &&
+        ws.ws_row > 0)
+    {
+      w = ws.ws_col;
+      h = ws.ws_row;
+      return;
+    }
+    const char *c = getenv("COLUMNS");
+    const char *l = getenv("LINES");
+    w = (c && atoi(c) > 0) ? atoi(c) : 80;
+    h = (l && atoi(l) > 0) ? atoi(l) : 24;
+  }
+
+  /// @return the next key like getch(), PgUp and PgDn are KEY_PPAGE and KEY_NPAGE.
+  int key()
+  {
+    if (in.empty())
+    {
+      char b[64];
+      const ssize_t n = (tty >= 0) ? read(tty, b, sizeof(b)) : -1;
+      if (n <= 0)
+        return ERR;
+      in.assign(b, n);
+    }
+    if (in.compare(0, 4, "\033[5~") == 0 ||
+        in.compare(0, 4, "\033[6~") == 0)
+    {
+      const int k = (in[2] == '5') ? KEY_PPAGE : KEY_NPAGE;
+      in.erase(0, 4);
+      return k;
+    }
+    const int ch = static_cast<unsigned char>(in[0]);
+    in.erase(0, 1);
+    return ch;
+  }
+
+  /// add the SGR sequence of the attributes @p a to out.
+  void sgr(const chtype a)
+  {
+    out += "\033[0";
+    if (a & A_BOLD)
+      out += ";1";
+    if (a & A_DIM)
+      out += ";2";
+    if (a & (A_REVERSE | A_STANDOUT))
+      out += ";7";
+    const size_t pair = PAIR_NUMBER(a);
+    if (pair > 0 &&
+        pair <= pair_colors.size())
+    {
+      out += ";3";
+      out += static_cast<char>('0' + pair_colors[pair - 1]);
+      out += ";40";
+    }
+    out += 'm';
+  }
+
+  /**
+   * write the cells of @p fb which changed since the previous frame.
+   * @param full if true clear the terminal and write all cells.
+   */
+  void write(const framebuffer_t &fb, const bool full)
+  {
+    out.clear();
+    if (full ||
+        fb.width != width ||
+        fb.height != height)
+    {
+      width = fb.width;
+      height = fb.height;
+      // the terminal is blank after the clear
+      cells.assign(width * height, ' ');
+      dots.assign(width * height, 0);
+      out += "\033[H\033[2J";
+    }
+    out += "\033[0m";
+    chtype attr = A_NORMAL;
+    bool alt = false;
+    for(int y = 0; y < height; ++y)
+    {
+      // range of changed cells in the row
+      const size_t row = y * width;
+      int b = 0, e = width;
+      while(b < e && cells[row + b] == fb.cells[row + b] && dots[row + b] == fb.dots[row + b])
+        ++b;
+      while(e > b && cells[row + e - 1] == fb.cells[row + e - 1] && dots[row + e - 1] == fb.dots[row + e - 1])
+        --e;
+      if (b == e)
+        continue;
+      char pos[32];
+      snprintf(pos, sizeof(pos), "\033[%d;%dH", y + 1, b + 1);
+      out += pos;
+      for(size_t i = row + b; i < row + e; ++i)
+      {
+        const chtype c = fb.cells[i];
+        const uint8_t d = fb.dots[i];
+        // move the cursor over longer runs of unchanged cells
+        size_t same = i;
+        while(same < row + e && cells[same] == fb.cells[same] && dots[same] == fb.dots[same])
+          ++same;
+        if (same - i >= ANSI_SKIP)
+        {
+          snprintf(pos, sizeof(pos), "\033[%zuC", same - i);
+          out += pos;
+          i = same - 1;
+          continue;
+        }
+        cells[i] = c;
+        dots[i] = d;
+        const chtype a = c & A_ATTRIBUTES & ~A_ALTCHARSET;
+        if (a != attr)
+        {
+          sgr(a);
+          attr = a;
+        }
+        const bool calt = (c & A_ALTCHARSET) && ! d;
+        if (calt != alt)
+        {
+          out += calt ? "\033(0" : "\033(B";
+          alt = calt;
+        }
+        if (d)
+        {
+          // UTF-8 of the braille pattern U+2800 + d
+          out += '\xe2';
+          out += static_cast<char>(0xa0 + (d >> 6));
+          out += static_cast<char>(0x80 + (d & 0x3f));
+        }
+        else
+        {
+          out += static_cast<char>(c & A_CHARTEXT);
+        }
+      }
+    }
+    if (alt)
+      out += "\033(B";
+    out += "\033[0m";
+    send();
+  }
+
+  /// write out to stdout.
+  void send()
+  {
+    size_t done = 0;
+    while(done < out.size())
+    {
+      const ssize_t n = ::write(STDOUT_FILENO, out.data() + done, out.size() - done);
+      if (n < 0 &&
+          errno == EINTR)
+        continue;
+      if (n <= 0)
+        break;
+      done += n;
+    }
+  }
+};
+
+ansi_t ansi;
+
 void
 draw_axes(const int plotheight, const int plotwidth)
 {
   // x axis
-  mvhline(plotheight, 1, T_HLINE, plotwidth-1);
-  mvaddch(plotheight, plotwidth-1, T_RARR);
+  fb.horizontal(plotheight, 1, T_HLINE, plotwidth-1);
+  fb.put(plotheight, plotwidth-1, T_RARR);
   // y axis
-  mvvline(1, 0, T_VLINE, plotheight-1);
-  mvaddch(0, 0, T_UARR);
+  fb.vertical(1, 0, T_VLINE, plotheight-1);
+  fb.put(0, 0, T_UARR);
   // corner
-  mvaddch(plotheight, 0, T_LLCR);
+  fb.put(plotheight, 0, T_LLCR);
 }
 
-std::string
-printValue(const double d, const char *unit)
+// size of the buffers of format_fixed() and printValue()
+#define FORMAT_SIZE 32
+
+/**
+ * write @p d with @p decimals digits after the point to @p p, like snprintf("%.*f")
+ * but without parsing a format string. Only values of 1e15 and more and exact ties,
+ * which printf rounds by their binary value, use snprintf().
+ * @param p buffer with FORMAT_SIZE bytes.
+ * @param decimals 0 to 3.
+ * @return end of the 0 terminated string.
+ */
+char*
+format_fixed(char *p, const double d, const int decimals)
 {
-  std::string s;
-  if (d < +0.01 &&
-      d > -0.01)
+  static const double scale[] = {1, 10, 100, 1000};
+  static const unsigned iscale[] = {1, 10, 100, 1000};
+  const double a = fabs(d) * scale[decimals];
+  const double ip = floor(a);
+  if (! (a < 1e15) ||
+      a - ip == 0.5)
   {
-    s = "0";
+    // large values are cut off at the end of the buffer
+    const int n = snprintf(p, FORMAT_SIZE, "%.*f", decimals, d);
+    return p + std::min(std::max(n, 0), FORMAT_SIZE - 1);
   }
-  else
+  uint64_t v = static_cast<uint64_t>(ip);
+  if (a - ip > 0.5)
+    ++v;
+  // printf keeps the sign of negative values which are rounded to 0
+  if (std::signbit(d))
+    *p++ = '-';
+  // digits in reverse order
+  char r[24];
+  int n = 0;
+  uint64_t i = v / iscale[decimals];
+  do
   {
-    char buf[16];
-    int len = snprintf(buf, sizeof(buf), "%.2f", d);
-    s.assign(buf, len);
-    auto pos = s.find('.');
-    if (pos != std::string::npos)
+    r[n++] = '0' + i % 10;
+    i /= 10;
+  } while(i);
+  while(n > 0)
+    *p++ = r[--n];
+  if (decimals > 0)
+  {
+    *p++ = '.';
+    unsigned f = v % iscale[decimals];
+    for(int k = decimals - 1; k >= 0; --k)
     {
-      while(s.back() == '0')
-      {
-        s.pop_back();
-      }
-      if (s.back() == '.')
-      {
-        s.pop_back();
-      }
+      p[k] = '0' + f % 10;
+      f /= 10;
     }
+    p += decimals;
   }
+  *p = 0;
+  return p;
+}
 
-  if (unit)
+/// write @p d with at most 2 decimals to @p buf.
+/// @param buf buffer with FORMAT_SIZE bytes.
+/// @return buf
+const char*
+printValue(char *buf, const double d)
+{
+  if (d < +0.01 &&
+      d > -0.01)
+  {
+    strcpy(buf, "0");
+    return buf;
+  }
+  char *e = format_fixed(buf, d, 2);
+  if (strchr(buf, '.'))
   {
-    s += ' ';
-    s += unit;
+    while(e[-1] == '0')
+      --e;
+    if (e[-1] == '.')
+      --e;
+    *e = 0;
   }
-  return s;
+  return buf;
 }
 
 void
@@ -156,13 +748,21 @@ draw_labels(const int plotheight,
             const double min,
             const char *unit)
 {
-  attron(A_BOLD);
-  mvprintw(0,              1, "%s", printValue(max,             unit).c_str());
-  mvprintw(plotheight/4,   1, "%s", printValue(min/4 + max*3/4, unit).c_str());
-  mvprintw(plotheight/2,   1, "%s", printValue(min/2 + max/2,   unit).c_str());
-  mvprintw(plotheight*3/4, 1, "%s", printValue(min*3/4 + max/4, unit).c_str());
-  mvprintw(plotheight-1,   1, "%s", printValue(min,             unit).c_str());
-  attroff(A_BOLD);
+  fb.attr = A_BOLD;
+  const auto label = [unit](const int y, const double d) {
+    char buf[FORMAT_SIZE];
+    const int x = fb.text(y, 1, printValue(buf, d));
+    if (unit)
+    {
+      fb.text(y, fb.text(y, x, " "), unit);
+    }
+  };
+  label(0,              max);
+  label(plotheight/4,   min/4 + max*3/4);
+  label(plotheight/2,   min/2 + max/2);
+  label(plotheight*3/4, min*3/4 + max/4);
+  label(plotheight-1,   min);
+  fb.attr = A_NORMAL;
 }
 
 void
@@ -179,11 +779,11 @@ draw_line(const int x,
   {
     if (pc == CHAR_REVERSE)
     {
-      mvchgat(y1, x, 1, A_REVERSE, COLOR_PAIR(0), NULL);
+      fb.set_attr(y1, x, A_REVERSE);
     }
     else
     {
-      mvaddch(y1, x, pc);
+      fb.put(y1, x, pc);
     }
     return;
   }
@@ -196,408 +796,3854 @@ draw_line(const int x,
   {
     for(; y1 < y2; ++y1)
     {
-      mvchgat(y1, x, 1, A_REVERSE, COLOR_PAIR(0), NULL);
+      fb.set_attr(y1, x, A_REVERSE);
     }
   }
   else
   {
-    mvvline(y1, x, pc, y2-y1);
+    fb.vertical(y1, x, pc, y2-y1);
   }
 }
 
-volatile bool sigwinch_received = false;
+/// move the plot area [1, plotwidth] of the screen @p n columns to the left.
 void
-resize(int sig)
+shift_plot(const int plotheight, const int plotwidth, const int n)
 {
-  (void) sig;
-  sigwinch_received = true;
+  fb.shift(plotheight, plotwidth, n);
 }
 
+/// clear the plot area of values with index [x_begin, x_end).
 void
-finish(int sig)
+clear_plot(const size_t x_begin, const size_t x_end, const int plotheight)
 {
-  (void) sig;
-  curs_set(FALSE);
-  echo();
-  refresh();
-  endwin();
-  delscreen(sp);
-  if (sig == SIGSEGV)
+  for(size_t x = x_begin; x < x_end; ++x)
   {
-    void* array[50];
-    const int frames = backtrace(array, 50);
-    fprintf(stderr, "\nprocess received SIGSEGV\n");
-    backtrace_symbols_fd(array, frames, 1);
-    exit(EXIT_FAILURE);
+    fb.vertical(0, x + 1, ' ', plotheight);
   }
-  exit(EXIT_SUCCESS);
 }
 
-struct values_t
+// with --braille a screen cell shows BRAILLE_X values and BRAILLE_Y rows of dots
+#define BRAILLE_X 2
+#define BRAILLE_Y 4
+
+/// bit of the Unicode braille pattern U+2800 + bits for the dot in row y and column x of a cell.
+constexpr uint8_t braille_dots[BRAILLE_Y][BRAILLE_X] = {
+  {0x01, 0x08},
+  {0x02, 0x10},
+  {0x04, 0x20},
+  {0x40, 0x80},
+};
+
+/// plot area of --braille. The graphs set dots of the cells, which are drawn at once,
+/// so graphs in the same cell are combined.
+struct braille_t
 {
-  // values of the graph
-  std::deque<double> vec;
-  // previous real value, used in rate mode
-  double pval;
-  // maximum value in vec
-  double max;
-  // minimum value in vec
-  double min;
-  // average value in vec
-  double avg;
-  // median value in vec
-  double med;
-  // graph name
-  std::string name;
-  // if true plot bars
-  bool bars;
-  // if true a value was pushed back in this update cycle
-  bool did_push_back;
-  // maximum size of vec of all values_t objects.
-  static size_t max_size;
+  // size of the plot area in cells
+  int width = 0;
+  int height = 0;
+  // braille pattern bits, attributes and the error character, which replaces the dots, of each cell
+  std::vector<uint8_t> dots;
+  std::vector<int> attrs;
+  std::vector<char> chars;
 
-  void init(std::string s)
+  void clear(const int w, const int h)
   {
-    assert(! s.empty());
-    name = std::move(s);
+    width = w;
+    height = h;
+    dots.assign(w * h, 0);
+    attrs.assign(w * h, 0);
+    chars.assign(w * h, 0);
   }
 
-  void push_back(const double cval, const size_t plotwidth, const bool b)
+  /**
+   * draw like draw_line() in dot coordinates: the dot y1 if it is y2, otherwise the dots [y1, y2).
+   * @param x screen column x displays the dot columns of the values with index 2*(x-1) and 2*(x-1)+1.
+   * @param pc error character or 0 for dots. The error character replaces the cell of a dot in the
+   *           first or last row, which is a value outside of the plot range.
+   */
+  void line(const int x, int y1, int y2, const char pc, const int attr)
   {
-    bars = b;
-    did_push_back = true;
-    // if this vector contains less elements than the largest other vector,
-    // resize this vector to the max size.
-    if (max_size > 0 &&
-        vec.size() < max_size - 1u)
+    if (y1 > y2)
     {
-      vec.resize(max_size - 1u, DOUBLE_UNINIT);
+      std::swap(y1, y2);
     }
-    // add the current value
-    vec.push_back(cval);
-    // remove first value if we store more than plotwidth
-    if (vec.size() > plotwidth)
+    if (y1 == y2)
     {
-      vec.pop_front();
+      ++y2;
     }
-    // update max_size
-    if (vec.size() > max_size)
+    const int cx = (x - 1) / BRAILLE_X;
+    if (cx < 0 ||
+        cx >= width)
+      return;
+    const int dx = (x - 1) % BRAILLE_X;
+    for(int y = std::max(y1, 0); y < y2 && y < height * BRAILLE_Y; ++y)
     {
-      max_size = vec.size();
+      const size_t i = (y / BRAILLE_Y) * width + cx;
+      if (pc &&
+          (y == 0 || y == height * BRAILLE_Y - 1))
+        chars[i] = pc;
+      else
+        dots[i] |= braille_dots[y % BRAILLE_Y][dx];
+      attrs[i] = attr;
     }
   }
 
-  /// change the last value in the vector to a rate value
-  void rate(const double td)
+  /// draw the cells with dots into the plot area of fb, which starts at column 1.
+  void draw() const
   {
-    const auto s = vec.size();
-    if (s == 0)
-      return;
-
-    if (s == 1)
+    for(int y = 0; y < height; ++y)
     {
-      pval = vec[0];
-      vec[0] = 0;
-      return;
+      for(int x = 0; x < width; ++x)
+      {
+        const size_t i = y * width + x;
+        if (! dots[i] &&
+            ! chars[i])
+          continue;
+        fb.attr = attrs[i];
+        fb.put(y, x + 1, chars[i] ? chars[i] : ' ');
+        if (! chars[i] &&
+            fb.inside(y, x + 1))
+        {
+          fb.dots[y * fb.width + x + 1] = dots[i];
+        }
+      }
     }
+    fb.attr = A_NORMAL;
+  }
+};
 
-    // the current value which was just added to the vector
-    const double cval = vec[s - 1];
+// with -F every screen column shows the spectrum of SPECTRUM_X values of the history
+#define SPECTRUM_X 2
+// characters of the --waterfall intensities, from the lowest to the highest amplitude
+#define WATERFALL_CHARS " .:-=+*#%@"
 
-    // detect 32 bit overflow
-    if (pval >= 0xffffff00 &&
-        cval >= 0.0 &&
-        cval < 0xff)
+/**
+ * radix-2 FFT for the spectrum of -F.
+ * The twiddle factors, the bit reversed indices and the Hann window are calculated once
+ * for a size, the buffers are reused for all graphs.
+ */
+struct fft_t
+{
+  // number of values, a power of 2
+  size_t n = 0;
+  std::vector<double> cos_t, sin_t, window;
+  std::vector<uint32_t> rev;
+  // values and their transform
+  std::vector<double> re, im;
+
+  /// prepare the tables for @p size values.
+  void init(const size_t size)
+  {
+    if (size == n)
+      return;
+    n = size;
+    cos_t.resize(n / 2);
+    sin_t.resize(n / 2);
+    for(size_t k = 0; k < n / 2; ++k)
     {
-      vec[s - 1] = cval + (pval - 0xffffff00);
+      cos_t[k] = cos(2 * M_PI * k / n);
+      sin_t[k] = -sin(2 * M_PI * k / n);
     }
-    // detect 31 bit overflow
-    else if (pval >= 0x7fffff00 &&
-             pval <= 0x7fffffff &&
-             cval >= 0.0 &&
-             cval < 0xff)
+    window.resize(n);
+    for(size_t i = 0; i < n; ++i)
     {
-      vec[s - 1] = cval + (pval - 0x7fffff00);
+      window[i] = 0.5 - 0.5 * cos(2 * M_PI * i / (n - 1));
     }
-    else
+    unsigned bits = 0;
+    while((size_t(1) << bits) < n)
+      ++bits;
+    rev.resize(n);
+    for(size_t i = 0; i < n; ++i)
     {
-      vec[s - 1] -= pval;
+      uint32_t r = 0;
+      for(unsigned b = 0; b < bits; ++b)
+      {
+        r |= ((i >> b) & 1) << (bits - 1 - b);
+      }
+      rev[i] = r;
     }
-    vec[s - 1] /= td;
-    pval = cval;
+    re.resize(n);
+    im.resize(n);
   }
 
-  /// calculate min, avg, max.
-  void update()
+  /**
+   * transform the n values in re.
+   * @param[out] amp amplitudes of the frequencies k/n of the values for k in [1, n/2].
+   *                 amp[0] is 0, the average of the values is removed.
+   */
+  void amplitudes(std::vector<double> &amp)
   {
-    if (vec.empty())
+    double mean = 0;
+    for(size_t i = 0; i < n; ++i)
+      mean += re[i];
+    mean /= n;
+    double wsum = 0;
+    for(size_t i = 0; i < n; ++i)
     {
-      min = max = avg = med = 0.0;
-      return;
+      im[i] = (re[i] - mean) * window[i];
+      wsum += window[i];
     }
-    double tot = 0;
-    min = DOUBLE_MAX;
-    max = DOUBLE_MIN;
-    size_t i = 0;
-    std::vector<double> med_vec;
-    med_vec.reserve(vec.size());
-    for(const auto val : vec)
+    for(size_t i = 0; i < n; ++i)
     {
-      if (val == DOUBLE_UNINIT)
-        continue;
-      if (val > max)
-        max = val;
-      if (val < min)
-        min = val;
-      tot += val;
-      ++i;
-      med_vec.push_back(val);
+      re[rev[i]] = im[i];
     }
-
-    if (med_vec.empty())
+    std::fill(im.begin(), im.end(), 0.0);
+    for(size_t len = 2; len <= n; len <<= 1)
     {
-      min = max = avg = med = 0.0;
-      return;
+      const size_t half = len / 2;
+      const size_t step = n / len;
+      for(size_t i = 0; i < n; i += len)
+      {
+        for(size_t k = 0; k < half; ++k)
+        {
+          const double wr = cos_t[k * step];
+          const double wi = sin_t[k * step];
+          const size_t a = i + k;
+          const size_t b = a + half;
+          const double tr = re[b] * wr - im[b] * wi;
+          const double ti = re[b] * wi + im[b] * wr;
+          re[b] = re[a] - tr;
+          im[b] = im[a] - ti;
+          re[a] += tr;
+          im[a] += ti;
+        }
+      }
     }
+    // the window reduces the amplitudes by its average
+    amp.resize(n / 2 + 1);
+    amp[0] = 0;
+    for(size_t k = 1; k <= n / 2; ++k)
+    {
+      amp[k] = 2 * sqrt(re[k] * re[k] + im[k] * im[k]) / wsum;
+    }
+  }
+};
 
-    avg = tot / i;
+/// layout and scale of a frame drawn on the screen.
+struct frame_t
+{
+  int screenwidth = 0;
+  int screenheight = 0;
+  int plotheight = 0;
+  // ids of the plotted graphs in drawing order
+  std::vector<size_t> graphs;
+  // scale of the plot
+  double max = 0;
+  double min = 0;
+  // generation of the last drawn values
+  size_t gen = 0;
+  // number of values drawn for each graph
+  size_t cols = 0;
 
-    std::sort(med_vec.begin(), med_vec.end());
-    med = med_vec[med_vec.size() / 2];
+  /// @return true if a frame with the same layout and scale as @p o is drawn.
+  bool same_layout(const frame_t &o) const
+  {
+    return o.screenwidth > 0 &&
+      screenwidth == o.screenwidth &&
+      screenheight == o.screenheight &&
+      plotheight == o.plotheight &&
+      graphs == o.graphs &&
+      max == o.max &&
+      min == o.min;
   }
+};
 
-  /**
-   * before calling plot(), update() should be called.
-   * @param idx index of plot that is drawn.
-   * @param n highest index of valid values in @p v
-   */
-  void plot(const unsigned idx,
-            const int screenwidth,
-            const int plotheight,
-            const double global_max,
-            const double global_min,
-            const char max_errchar,
-            const char min_errchar,
-            const double hardmax) const
+volatile bool sigwinch_received = false;
+void
+resize(int sig)
+{
+  (void) sig;
+  sigwinch_received = true;
+}
+
+// with --headless or --state SIGINT and SIGTERM end the main loop, which writes the last summary
+// or the state file before ttyplot exits
+volatile bool stop_received = false;
+void
+stop(int sig)
+{
+  (void) sig;
+  stop_received = true;
+}
+
+/// ring buffer of elements with a power of two capacity.
+/// The elements are stored in one contiguous array, memory is only allocated when
+/// the capacity grows.
+template<typename T>
+class ring_t
+{
+  std::vector<T> buf;
+  // buf.size() - 1
+  size_t mask = 0;
+  // index of the first element in buf
+  size_t head = 0;
+  // number of elements
+  size_t n = 0;
+
+public:
+  size_t size() const { return n; }
+  bool empty() const { return n == 0; }
+  size_t capacity() const { return buf.size(); }
+
+  /// grow the capacity to at least @p c elements. The elements are kept.
+  void reserve(const size_t c)
+  {
+    if (c <= buf.size())
+      return;
+    size_t newcap = 1;
+    while(newcap < c)
+      newcap <<= 1;
+    std::vector<T> newbuf(newcap);
+    for(size_t i = 0; i < n; ++i)
+    {
+      newbuf[i] = (*this)[i];
+    }
+    buf.swap(newbuf);
+    mask = newcap - 1;
+    head = 0;
+  }
+
+  T& operator[](const size_t i)
+  {
+    assert(i < n);
+    return buf[(head + i) & mask];
+  }
+  const T& operator[](const size_t i) const
   {
-    if (vec.empty())
+    assert(i < n);
+    return buf[(head + i) & mask];
+  }
+  T& front() { return (*this)[0]; }
+  T& back() { return (*this)[n - 1]; }
+  const T& front() const { return (*this)[0]; }
+  const T& back() const { return (*this)[n - 1]; }
+
+  void push_back(const T &v)
+  {
+    if (n == buf.size())
     {
+      reserve(n + 1);
+    }
+    buf[(head + n++) & mask] = v;
+  }
+  void pop_front()
+  {
+    assert(n > 0);
+    head = (head + 1) & mask;
+    --n;
+  }
+  void pop_back()
+  {
+    assert(n > 0);
+    --n;
+  }
+  void clear()
+  {
+    head = n = 0;
+  }
+
+  /// call @p f with (pointer, number of elements) for the contiguous parts of the elements [b, e).
+  template<typename F>
+  void spans(const size_t b, const size_t e, F f) const
+  {
+    if (b >= e)
       return;
+    const size_t s = (head + b) & mask;
+    const size_t len = e - b;
+    const size_t first = std::min(len, buf.size() - s);
+    f(buf.data() + s, first);
+    if (first < len)
+      f(buf.data(), len - first);
+  }
+};
+
+/**
+ * start of a --state file, which is followed by the records of the graphs.
+ * Values are stored in the byte order of the machine, sizes as 64 bit numbers.
+ */
+struct state_header_t
+{
+  uint32_t magic;
+  uint32_t version;
+  // options which change the meaning of the values and the bucket size
+  uint32_t options;
+  // 0 while the graphs are written, a file which is not clean is not read
+  uint32_t clean;
+  uint64_t bucket_ms;
+  uint64_t gen;
+  double time;
+  double global_max;
+  double global_min;
+  double t1;
+  double td;
+  // bytes of the header and the records, the file may be larger
+  uint64_t used;
+};
+
+/**
+ * record of a graph in a --state file. It is followed by the key, padded to 8 bytes, and rings
+ * of cap doubles: the values, in bucket mode their minimum and maximum, and the average, minimum
+ * and maximum of each tier. Value i, counted by values_t::seq, is in slot i % cap and column c
+ * of a tier in slot c % cap, so new values are written into their slots without moving others.
+ */
+struct state_graph_t
+{
+  // bytes of the record with the key and the rings
+  uint64_t size;
+  // 1 if the graph was moved to a later record, because its capacity changed
+  uint64_t moved;
+  uint64_t key_size;
+  // slots of each ring, a power of 2
+  uint64_t cap;
+  uint64_t window;
+  uint64_t gen;
+  uint64_t seq;
+  // number of values in the rings, the last value is seq - 1
+  uint64_t values;
+  double pval;
+  double pts;
+  double ptd;
+  uint64_t open;
+  double open_sum;
+  uint64_t open_n;
+  struct
+  {
+    // number of columns in the rings, the last column is next - 1
+    uint64_t columns;
+    uint64_t next;
+    double sum;
+    uint64_t n;
+  } tier[ZOOM_LEVELS - 1];
+
+  /// @return the number of rings of a graph.
+  static size_t rings(const bool bucket)
+  {
+    return (bucket ? 3 : 1) + 3 * (ZOOM_LEVELS - 1);
+  }
+  /// @return the bytes of a record.
+  static size_t bytes(const size_t key_size, const size_t cap, const bool bucket)
+  {
+    return sizeof(state_graph_t) + (key_size + 7) / 8 * 8 + rings(bucket) * cap * sizeof(double);
+  }
+  char* key()
+  {
+    return reinterpret_cast<char*>(this + 1);
+  }
+  /// @return ring @p r.
+  double* ring(const size_t r)
+  {
+    return reinterpret_cast<double*>(key() + (key_size + 7) / 8 * 8) + r * cap;
+  }
+};
+
+/// spectra of the first graph for --waterfall. The newest is drawn in the top row of the plot.
+struct waterfall_t
+{
+  // the rows keep their capacity when old spectra are replaced
+  ring_t<std::vector<double>> rows;
+
+  void add(const std::vector<double> &amp, const size_t max_rows)
+  {
+    while(rows.size() >= max_rows &&
+          ! rows.empty())
+    {
+      rows.pop_front();
     }
+    rows.push_back(amp);
+  }
 
-    // y screen coordinate of previous row
-    int lasty = INT_UNINIT;
-    const double mymax = global_max - global_min;
+  /// @return the largest amplitude.
+  double max() const
+  {
+    double m = 0;
+    for(size_t i = 0; i < rows.size(); ++i)
+    {
+      for(const auto a : rows[i])
+        m = std::max(m, a);
+    }
+    return m;
+  }
 
-    for(unsigned x = 0; x < vec.size(); ++x)
+  /// draw the spectra with the characters of WATERFALL_CHARS in the screen columns [1, @p cols].
+  void draw(const int cols,
+            const int plotheight,
+            const double global_max,
+            const double global_min) const
+  {
+    static const char ramp[] = WATERFALL_CHARS;
+    const int levels = sizeof(ramp) - 2;
+    const double range = global_max - global_min;
+    // all amplitudes are at the bottom of the scale
+    if (range <= 0)
+      return;
+    for(int y = 0; y < plotheight && static_cast<size_t>(y) < rows.size(); ++y)
     {
-      const auto val = vec[x];
-      // skip points which have not been initialized
-      if (val == DOUBLE_UNINIT)
-      {
-        lasty = INT_UNINIT;
+      const auto &amp = rows[rows.size() - 1 - y];
+      if (amp.size() < 2)
         continue;
-      }
-      char pc;  // plot character
-      int y;    // y coordinate of the value
-      // check for min and max
-      if (val >= hardmax)
-      {
-        y = 0;
-        pc = max_errchar;
-      }
-      else if (val <= global_min)
-      {
-        y = plotheight - 1;
-        pc = min_errchar;
-      }
-      // regular point
-      else
-      {
-        y = plotheight - static_cast<int>((val-global_min) / mymax * plotheight) - 1;
-        if (y < 0)
-          y = 0;
-        pc = name[0];
-      }
-      // adjust lasty to draw a bar or a point
-      if (bars)
-      {
-        lasty = plotheight;
-      }
-      else if (lasty == INT_UNINIT)
+      const size_t bins = amp.size() - 1;
+      for(int x = 0; x < cols; ++x)
       {
-        lasty = y;
+        const int l = static_cast<int>((amp[1 + x * bins / cols] - global_min) / range * levels + 0.5);
+        if (l > 0)
+        {
+          fb.put(y, x + 1, ramp[std::min(l, levels)]);
+        }
       }
-      // draw
-      draw_line(x+1, lasty, y, pc);
-      lasty = y;
     }
+  }
+};
 
-    // calculate screen position of details
-    int x, y;
-    if (screenwidth < SCREENWIDTH_FOR_2COLUMN)
+/**
+ * drawing order of the graphs in the columns of -k -b. The highest bar of a column is drawn first
+ * and the lowest last, so every graph is visible. The order of a column is calculated once and kept
+ * until the column leaves the plot, only a column which still receives values is ranked again.
+ */
+struct bar_order_t
+{
+  // graphs and zoom level of the orders
+  std::vector<size_t> graphs;
+  unsigned zoom = 0;
+  // number of the column of orders[0] and the order of each column as indexes into graphs,
+  // an empty order is not calculated yet
+  size_t base = 0;
+  ring_t<std::vector<uint32_t>> orders;
+
+  /// forget the orders if the graphs or the zoom level differ from the orders.
+  void reset(const std::vector<size_t> &g, const unsigned z)
+  {
+    if (g == graphs &&
+        z == zoom)
+      return;
+    graphs = g;
+    zoom = z;
+    orders.clear();
+  }
+
+  /**
+   * @param col number of the column since the first sample, which identifies it while the plot moves.
+   * @param keep number of columns before @p col which are kept.
+   * @param changing true if the column still receives values.
+   * @param bar function which returns the height of the bar of the graph with an index into graphs.
+   * @return indexes into graphs in drawing order.
+   */
+  template<typename Bar>
+  const std::vector<uint32_t>& order(const size_t col, const size_t keep, const bool changing, const Bar &bar)
+  {
+    if (orders.empty() ||
+        col < base ||
+        col >= base + orders.size() + keep)
     {
-      x = 0;
-      y = plotheight + idx + 1;
+      orders.clear();
+      base = col;
     }
-    else
+    while(base + orders.size() <= col)
     {
-      x = (idx & 1) * SCREENWIDTH_FOR_2COLUMN / 2;
-      y = plotheight + idx/2 + 1;
+      orders.push_back(std::vector<uint32_t>());
     }
-    // print the detail name
-    if (name[0] == CHAR_REVERSE &&
-        name.size() == 1)
+    while(base + keep < col)
     {
-      attron(A_REVERSE);
-      mvaddch(y, x, CHAR_REVERSE);
-      attroff(A_REVERSE);
+      orders.pop_front();
+      ++base;
     }
-    else
+    auto &o = orders[col - base];
+    if (o.size() == graphs.size() &&
+        ! changing)
+      return o;
+    o.resize(graphs.size());
+    std::vector<double> &h = heights;
+    h.resize(graphs.size());
+    for(uint32_t i = 0; i < o.size(); ++i)
     {
-      mvprintw(y, x, "%s", name.c_str());
+      o[i] = i;
+      h[i] = bar(i);
     }
-    // print details
-    printw(" last=%.1f min=%.1f max=%.1f avg=%.1f med=%.1f ", last(), min, max, avg, med);
+    std::sort(o.begin(), o.end(), [&h](const uint32_t a, const uint32_t b) {
+        return h[a] > h[b] || (h[a] == h[b] && a < b);
+      });
+    return o;
   }
 
-  /// @return last valid value.
-  /// @return 0 if no valid value is found.
-  double last() const
-  {
-    for(auto it = vec.rbegin(); it != vec.rend(); ++it)
-    {
-      if (*it != DOUBLE_UNINIT)
-      {
-        return *it;
-      }
-    }
-    return 0;
-  }
+private:
+  // bar heights of the column which is ranked
+  std::vector<double> heights;
 };
 
-size_t values_t::max_size = 0;
+// vector operations for the statistics kernels, VLANES is the number of doubles in a vector.
+// vmin() and vmax() return the second argument if the first is NaN.
+#if defined(__AVX__)
+#define VLANES 4
+typedef __m256d vdouble_t;
+inline vdouble_t vset(const double v) { return _mm256_set1_pd(v); }
+inline vdouble_t vload(const double *p) { return _mm256_loadu_pd(p); }
+inline void vstore(double *p, const vdouble_t v) { _mm256_storeu_pd(p, v); }
+inline vdouble_t vadd(const vdouble_t a, const vdouble_t b) { return _mm256_add_pd(a, b); }
+inline vdouble_t vmin(const vdouble_t v, const vdouble_t m) { return _mm256_min_pd(v, m); }
+inline vdouble_t vmax(const vdouble_t v, const vdouble_t m) { return _mm256_max_pd(v, m); }
+/// @return @p a where @p v is not NaN, 0 where it is NaN.
+inline vdouble_t vvalid(const vdouble_t v, const vdouble_t a) { return _mm256_and_pd(_mm256_cmp_pd(v, v, _CMP_ORD_Q), a); }
+#elif defined(__SSE2__)
+#define VLANES 2
+typedef __m128d vdouble_t;
+inline vdouble_t vset(const double v) { return _mm_set1_pd(v); }
+inline vdouble_t vload(const double *p) { return _mm_loadu_pd(p); }
+inline void vstore(double *p, const vdouble_t v) { _mm_storeu_pd(p, v); }
+inline vdouble_t vadd(const vdouble_t a, const vdouble_t b) { return _mm_add_pd(a, b); }
+inline vdouble_t vmin(const vdouble_t v, const vdouble_t m) { return _mm_min_pd(v, m); }
+inline vdouble_t vmax(const vdouble_t v, const vdouble_t m) { return _mm_max_pd(v, m); }
+inline vdouble_t vvalid(const vdouble_t v, const vdouble_t a) { return _mm_and_pd(_mm_cmpord_pd(v, v), a); }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define VLANES 2
+typedef float64x2_t vdouble_t;
+inline vdouble_t vset(const double v) { return vdupq_n_f64(v); }
+inline vdouble_t vload(const double *p) { return vld1q_f64(p); }
+inline void vstore(double *p, const vdouble_t v) { vst1q_f64(p, v); }
+inline vdouble_t vadd(const vdouble_t a, const vdouble_t b) { return vaddq_f64(a, b); }
+inline vdouble_t vmin(const vdouble_t v, const vdouble_t m) { return vminnmq_f64(v, m); }
+inline vdouble_t vmax(const vdouble_t v, const vdouble_t m) { return vmaxnmq_f64(v, m); }
+inline vdouble_t vvalid(const vdouble_t v, const vdouble_t a) { return vbslq_f64(vceqq_f64(v, v), a, vdupq_n_f64(0)); }
+#endif
 
-std::map<std::string, values_t> values;
-void
-push_back(const std::string &s, const double v, const size_t plotwidth, const bool bars)
+/**
+ * add the values in [p, p+n) to @p sum, NaN values are missing and skipped.
+ * @return number of values which are not NaN.
+ */
+size_t
+sum_valid(const double *p, const size_t n, double &sum)
 {
-  if (s.empty())
-    return;
-  auto it = values.find(s);
-  if (it != values.end())
+  size_t i = 0;
+  double cnt = 0;
+#ifdef VLANES
+  // two accumulators hide the latency of the additions
+  vdouble_t vs0 = vset(0), vs1 = vset(0), vc0 = vset(0), vc1 = vset(0);
+  const vdouble_t one = vset(1);
+  for(; i + 2 * VLANES <= n; i += 2 * VLANES)
   {
-    it->second.push_back(v, plotwidth, bars);
-    return;
+    const vdouble_t v0 = vload(p + i);
+    const vdouble_t v1 = vload(p + i + VLANES);
+    vs0 = vadd(vs0, vvalid(v0, v0));
+    vs1 = vadd(vs1, vvalid(v1, v1));
+    vc0 = vadd(vc0, vvalid(v0, one));
+    vc1 = vadd(vc1, vvalid(v1, one));
+  }
+  double s[VLANES], c[VLANES];
+  vstore(s, vadd(vs0, vs1));
+  vstore(c, vadd(vc0, vc1));
+  for(int l = 0; l < VLANES; ++l)
+  {
+    sum += s[l];
+    cnt += c[l];
+  }
+#endif
+  for(; i < n; ++i)
+  {
+    const bool ok = p[i] == p[i];
+    sum += ok ? p[i] : 0;
+    cnt += ok;
   }
-  auto &val = values[s];
-  val.init(s);
-  val.push_back(v, plotwidth, bars);
+  return static_cast<size_t>(cnt);
 }
 
-int
-parseColors(const std::string &color_str)
+/// @return the minimum of @p m and the values in [p, p+n) which are not NaN.
+double
+min_valid(const double *p, const size_t n, double m)
 {
-  if (color_str.empty())
-    return -1;
-  bool ret = true;
-  int parsed_colors = 0;
-  std::istringstream is(color_str);
-  while(is)
+  size_t i = 0;
+#ifdef VLANES
+  vdouble_t vm0 = vset(m), vm1 = vm0;
+  for(; i + 2 * VLANES <= n; i += 2 * VLANES)
   {
-    std::string col_str;
-    if (is >> col_str)
-    {
-      int col = -1;
-      if (col_str == "black" ||
-          col_str == "blk" ||
-          col_str == "bk")
-      {
-        col = COLOR_BLACK;
-      }
-      else if (col_str == "red" ||
-               col_str == "rd")
-      {
-        col = COLOR_RED;
-      }
-      else if (col_str == "green" ||
-               col_str == "grn" ||
-               col_str == "gr")
-      {
-        col = COLOR_GREEN;
-      }
-      else if (col_str == "yellow" ||
-               col_str == "yel" ||
-               col_str == "yl")
-      {
-        col = COLOR_YELLOW;
-      }
-      else if (col_str == "blue" ||
-               col_str == "blu" ||
-               col_str == "bl")
-      {
-        col = COLOR_BLUE;
-      }
-      else if (col_str == "magenta" ||
-               col_str == "mag" ||
-               col_str == "mg")
-      {
-        col = COLOR_MAGENTA;
-      }
-      else if (col_str == "cyan" ||
-               col_str == "cyn" ||
-               col_str == "cy" ||
-               col_str == "cn")
-      {
-        col = COLOR_CYAN;
-      }
-      else if (col_str == "white" ||
-               col_str == "wht" ||
-               col_str == "wh")
-      {
-        col = COLOR_WHITE;
-      }
-      else
-      {
-        printf("unknown color: %s\n", col_str.c_str());
-        ret = false;
-        continue;
-      }
-      assert(col >= 0);
-      // \todo get default background color
-      int res = init_pair(++parsed_colors, col, COLOR_BLACK);
-      assert(res == OK);
-    }
+    vm0 = vmin(vload(p + i), vm0);
+    vm1 = vmin(vload(p + i + VLANES), vm1);
   }
-  if (! ret)
+  double r[VLANES];
+  vstore(r, vmin(vm0, vm1));
+  for(int l = 0; l < VLANES; ++l)
+    m = std::min(m, r[l]);
+#endif
+  for(; i < n; ++i)
   {
-    exit(EXIT_FAILURE);
+    // false for NaN
+    m = (p[i] < m) ? p[i] : m;
   }
-  return parsed_colors;
+  return m;
 }
 
-/// @return number of milliseconds since unix epoch.
-size_t
-getms()
+/// @return the maximum of @p m and the values in [p, p+n) which are not NaN.
+double
+max_valid(const double *p, const size_t n, double m)
 {
-  size_t ms = 0;
-  struct timeval tv;
-  if (gettimeofday(&tv, NULL) == 0)
+  size_t i = 0;
+#ifdef VLANES
+  vdouble_t vm0 = vset(m), vm1 = vm0;
+  for(; i + 2 * VLANES <= n; i += 2 * VLANES)
+  {
+    vm0 = vmax(vload(p + i), vm0);
+    vm1 = vmax(vload(p + i + VLANES), vm1);
+  }
+  double r[VLANES];
+  vstore(r, vmax(vm0, vm1));
+  for(int l = 0; l < VLANES; ++l)
+    m = std::max(m, r[l]);
+#endif
+  for(; i < n; ++i)
   {
-    ms = tv.tv_sec;
-    ms *= 1000u;
-    ms += tv.tv_usec / 1000u;
+    m = (p[i] > m) ? p[i] : m;
   }
-  return ms;
+  return m;
 }
 
-int
-main(int argc, char *argv[])
+/// allocator which keeps released memory in a free list for the next allocation.
+/// Used for node based containers which are modified for every sample.
+template<typename T>
+struct pool_allocator
 {
-  const std::string one_str = "1";
-  const std::string two_str = "2";
-  int plotwidth=0, plotheight=0;
-  int c;
+  typedef T value_type;
+
+  pool_allocator() {}
+  template<typename U>
+  pool_allocator(const pool_allocator<U> &) {}
+
+  T* allocate(const size_t n)
+  {
+    if (n == 1 && free_list)
+    {
+      auto p = free_list;
+      free_list = *reinterpret_cast<void**>(p);
+      return static_cast<T*>(p);
+    }
+    return static_cast<T*>(::operator new(std::max(n * sizeof(T), sizeof(void*))));
+  }
+  void deallocate(T *p, const size_t n)
+  {
+    if (n != 1)
+    {
+      ::operator delete(p);
+      return;
+    }
+    *reinterpret_cast<void**>(p) = free_list;
+    free_list = p;
+  }
+
+  static void *free_list;
+};
+template<typename T>
+void *pool_allocator<T>::free_list = nullptr;
+template<typename T, typename U>
+bool operator==(const pool_allocator<T> &, const pool_allocator<U> &) { return true; }
+template<typename T, typename U>
+bool operator!=(const pool_allocator<T> &, const pool_allocator<U> &) { return false; }
+
+/// counters and timings of ttyplot itself, shown in the status line and printed with --stats.
+struct metrics_t
+{
+  // values added to the graphs
+  size_t samples = 0;
+  // samples merged into the latest sample with --overflow=coalesce, counted by the reader thread
+  std::atomic<size_t> coalesced{0};
+  // samples merged into an existing bucket of --bucket
+  size_t bucketed = 0;
+  // values which left the plot before they were drawn
+  size_t undrawn = 0;
+  // samples which were dropped with --overflow=drop
+  std::atomic<size_t> dropped{0};
+  // invalid input which was skipped, counted by the reader thread
+  std::atomic<size_t> invalid{0};
+  // number of frames drawn
+  size_t frames = 0;
+  // render time of the last FRAME_TIMES frames in microseconds
+  ring_t<size_t> frame_us;
+  // sum and maximum of all frame render times in microseconds
+  size_t frame_us_sum = 0;
+  size_t frame_us_max = 0;
+  // time of update() for all graphs in the last frame and the sum of all frames
+  size_t update_us = 0;
+  size_t update_us_sum = 0;
+  // bytes of input waiting to be read when the last frame was drawn and the maximum
+  size_t backlog = 0;
+  size_t backlog_max = 0;
+  // records waiting in the queue from the reader thread when the last frame was drawn and the maximum
+  size_t queued = 0;
+  size_t queued_max = 0;
+  // time when ttyplot was started
+  size_t start_ms = 0;
+  // samples per second measured over at least one second
+  double rate = 0;
+  size_t rate_samples = 0;
+  size_t rate_ms = 0;
+
+  /// record a frame which took @p us microseconds and @p upd microseconds in update().
+  void frame(const size_t us, const size_t upd)
+  {
+    ++frames;
+    if (frame_us.size() == FRAME_TIMES)
+    {
+      frame_us.pop_front();
+    }
+    frame_us.push_back(us);
+    frame_us_sum += us;
+    frame_us_max = std::max(frame_us_max, us);
+    update_us = upd;
+    update_us_sum += upd;
+  }
+
+  /// update the sample rate at time @p ms.
+  void update_rate(const size_t ms)
+  {
+    if (rate_ms == 0)
+    {
+      rate_ms = ms;
+      rate_samples = samples;
+    }
+    else if (ms - rate_ms >= 1000)
+    {
+      rate = (samples - rate_samples) * 1000.0 / (ms - rate_ms);
+      rate_ms = ms;
+      rate_samples = samples;
+    }
+  }
+
+  /// @return average and 99th percentile of the recent frame times in milliseconds.
+  std::pair<double, double> frame_ms() const
+  {
+    if (frame_us.empty())
+      return std::make_pair(0.0, 0.0);
+    static std::vector<size_t> v;
+    v.clear();
+    size_t sum = 0;
+    for(size_t i = 0; i < frame_us.size(); ++i)
+    {
+      v.push_back(frame_us[i]);
+      sum += frame_us[i];
+    }
+    const size_t p99 = v.size() * 99 / 100;
+    std::nth_element(v.begin(), v.begin() + p99, v.end());
+    return std::make_pair(sum / 1000.0 / v.size(), v[p99] / 1000.0);
+  }
+
+  /// print the status line at row @p y.
+  void status(const int y, const int screenwidth) const
+  {
+    const auto ft = frame_ms();
+    char s[256];
+    snprintf(s, sizeof(s), "%.0f samples/s  frame avg=%.2fms p99=%.2fms  update=%.2fms  backlog=%zu queued=%zu  coalesced=%zu  dropped=%zu  undrawn=%zu  invalid=%zu",
+             rate, ft.first, ft.second, update_us / 1000.0, backlog, queued, coalesced.load(), dropped.load(), undrawn, invalid.load());
+    fb.attr = A_REVERSE;
+    fb.text(y, 0, s, screenwidth);
+    fb.attr = A_NORMAL;
+  }
+
+  /// print all counters to @p f.
+  void dump(FILE *f) const
+  {
+    const double sec = (getms() - start_ms) / 1000.0;
+    fprintf(f, "run time:   %.3fs\n", sec);
+    fprintf(f, "samples:    %zu (%.0f/s)\n", samples, sec > 0 ? samples / sec : 0.0);
+    fprintf(f, "coalesced:  %zu\n", coalesced.load());
+    fprintf(f, "dropped:    %zu\n", dropped.load());
+    fprintf(f, "bucketed:   %zu\n", bucketed);
+    fprintf(f, "undrawn:    %zu\n", undrawn);
+    fprintf(f, "invalid:    %zu\n", invalid.load());
+    fprintf(f, "frames:     %zu (%.1f/s)\n", frames, sec > 0 ? frames / sec : 0.0);
+    if (frames > 0)
+    {
+      const auto ft = frame_ms();
+      fprintf(f, "frame time: avg=%.3fms p99=%.3fms max=%.3fms\n",
+              frame_us_sum / 1000.0 / frames, ft.second, frame_us_max / 1000.0);
+      fprintf(f, "update:     avg=%.3fms\n", update_us_sum / 1000.0 / frames);
+    }
+    fprintf(f, "backlog:    max=%zu bytes\n", backlog_max);
+    fprintf(f, "queued:     max=%zu records\n", queued_max);
+  }
+};
+
+metrics_t metrics;
+
+void
+finish(int sig)
+{
+  (void) sig;
+  if (sp)
+  {
+    curs_set(FALSE);
+    echo();
+    refresh();
+    endwin();
+    delscreen(sp);
+  }
+  ansi.end();
+  if (sig == SIGSEGV)
+  {
+    void* array[50];
+    const int frames = backtrace(array, 50);
+    fprintf(stderr, "\nprocess received SIGSEGV\n");
+    backtrace_symbols_fd(array, frames, 1);
+    exit(EXIT_FAILURE);
+  }
+  if (print_stats)
+  {
+    metrics.dump(stderr);
+  }
+  exit(EXIT_SUCCESS);
+}
+
+/**
+ * DDSketch of the samples for quantiles with a relative error of SKETCH_ALPHA in constant memory.
+ * Bin i counts the values in (gamma^(i-1), gamma^i]. If more than SKETCH_BINS bins are needed
+ * the bins of the values closest to 0 are merged.
+ */
+struct sketch_t
+{
+  /// bins of the positive or of the negated negative values.
+  struct store_t
+  {
+    // counts of the bins [offset, offset + bins.size())
+    std::vector<size_t> bins;
+    int offset = 0;
+
+    void add(int i)
+    {
+      if (bins.empty())
+      {
+        bins.push_back(0);
+        offset = i;
+      }
+      // bins which would be merged are not created
+      const int low = offset + static_cast<int>(bins.size()) - SKETCH_BINS;
+      if (i < low)
+      {
+        i = low;
+      }
+      if (i < offset)
+      {
+        bins.insert(bins.begin(), offset - i, 0);
+        offset = i;
+      }
+      else if (i >= offset + static_cast<int>(bins.size()))
+      {
+        bins.resize(i - offset + 1, 0);
+        if (bins.size() > SKETCH_BINS)
+        {
+          const size_t m = bins.size() - SKETCH_BINS;
+          for(size_t k = 0; k < m; ++k)
+            bins[m] += bins[k];
+          bins.erase(bins.begin(), bins.begin() + m);
+          offset += m;
+        }
+      }
+      ++bins[i - offset];
+    }
+  };
+  store_t pos, neg;
+  size_t zero = 0;
+  size_t n = 0;
+
+  static double log_gamma()
+  {
+    static const double l = log((1 + SKETCH_ALPHA) / (1 - SKETCH_ALPHA));
+    return l;
+  }
+
+  /// add @p v, values which are not finite are ignored.
+  void add(const double v)
+  {
+    if (! std::isfinite(v))
+      return;
+    ++n;
+    const double a = fabs(v);
+    if (a < SKETCH_MIN)
+    {
+      ++zero;
+      return;
+    }
+    const int i = static_cast<int>(ceil(log(a) / log_gamma()));
+    if (v > 0)
+      pos.add(i);
+    else
+      neg.add(i);
+  }
+
+  /// @return the value represented by bin @p i.
+  static double value(const int i)
+  {
+    return 2 * exp(i * log_gamma()) / (1 + (1 + SKETCH_ALPHA) / (1 - SKETCH_ALPHA));
+  }
+
+  /// @return the quantile @p q in [0, 1] of the added values, 0 if there are none.
+  double quantile(const double q) const
+  {
+    if (n == 0)
+      return 0;
+    const size_t rank = static_cast<size_t>(q * (n - 1) + 0.5);
+    size_t c = 0;
+    for(size_t k = neg.bins.size(); k > 0; --k)
+    {
+      c += neg.bins[k - 1];
+      if (c > rank)
+        return -value(neg.offset + k - 1);
+    }
+    c += zero;
+    if (c > rank)
+      return 0;
+    for(size_t k = 0; k < pos.bins.size(); ++k)
+    {
+      c += pos.bins[k];
+      if (c > rank)
+        return value(pos.offset + k);
+    }
+    return value(pos.offset + pos.bins.size() - 1);
+  }
+};
+
+struct values_t
+{
+  // values of the graph
+  ring_t<double> vec;
+  // previous real value, used in rate mode
+  double pval = DOUBLE_UNINIT;
+  // in rate mode the time of the previous value and the previous interval in seconds
+  double pts = 0;
+  double ptd = 1;
+  // maximum plotted value
+  double max;
+  // minimum plotted value
+  double min;
+  // average plotted value
+  double avg;
+  // median plotted value
+  double med;
+  // graph name
+  std::string name;
+  // key used to find the graph in the values table
+  std::string key;
+  // if true plot bars
+  bool bars;
+  // generation of the last value in vec. All graphs advance one generation
+  // for each sample or line of key/value pairs, or in bucket mode for each time
+  // bucket. Missing values are padded with DOUBLE_MISSING.
+  size_t gen = 0;
+  // time bucket size in milliseconds, 0 if every sample is one value in vec.
+  static size_t bucket_ms;
+  // in bucket mode vec holds the average of the samples in each bucket and lo/hi
+  // the minimum/maximum.
+  ring_t<double> lo, hi;
+  // in bucket mode true if the last bucket in vec still receives samples.
+  // An open bucket is not part of the statistics yet.
+  bool open = false;
+  // sum and number of samples in the open bucket
+  double open_sum = 0;
+  size_t open_n = 0;
+  // number of the last values in vec which are plotted and part of the statistics.
+  // vec keeps older values if the plot width shrinks.
+  size_t window = 0;
+  // plotted zoom level, 0 plots vec and level z plots tiers[z-1].
+  static unsigned zoom;
+  // quantiles in [0, 1] of --quantiles, which replace the median in the details
+  static std::vector<double> quantiles;
+  // if true the quantiles are calculated from all samples instead of the plotted columns
+  static bool all_time;
+  // all samples for the quantiles of all_time
+  sketch_t sketch;
+  // values of the quantiles, calculated by update()
+  std::vector<double> qv;
+  // statistics of the last details() line and the formatted line, which keeps its capacity
+  double detail_stats[5];
+  std::vector<double> detail_qv;
+  std::string detail_line;
+  // amplitudes of -F and seq when they were calculated
+  std::vector<double> spectrum;
+  size_t spectrum_seq = 0;
+  // aggregated history, a column of tiers[t] holds ZOOM_FACTOR^(t+1) generations.
+  struct tier_t
+  {
+    // average, minimum and maximum of the valid values of each column
+    ring_t<double> avg, lo, hi;
+    // sum and number of valid values in the last column
+    double sum = 0;
+    size_t n = 0;
+    // index of the next column, generation g is in column (g-1)/ZOOM_FACTOR^(t+1)
+    size_t next = 0;
+    // next when the tier was written to the --state file the last time
+    size_t saved_next = 0;
+  };
+  tier_t tiers[ZOOM_LEVELS - 1];
+
+  // statistics of the valid values in the window, updated by push() and rebuild_stats().
+  // number of values ever added to vec, used as index for the min/max queues.
+  size_t seq = 0;
+  // seq when the graph was drawn the last time
+  size_t drawn_seq = 0;
+  // seq when the graph was written to the --state file the last time
+  size_t saved_seq = 0;
+  // number of samples since the last --headless summary
+  size_t samples = 0;
+  // number of valid values in the window
+  size_t count = 0;
+  // sum of valid values in the window
+  double sum = 0;
+  // monotonic queues of (seq, value) pairs. The front holds the minimum/maximum
+  // of the values in the window, values which can never become the minimum/maximum are removed.
+  // In bucket mode the queues hold the bucket minimum/maximum.
+  ring_t<std::pair<size_t, double>> min_queue, max_queue;
+  // sorted valid values in the window and iterator to the median at index size/2
+  typedef std::multiset<double, std::less<double>, pool_allocator<double>> sorted_t;
+  sorted_t sorted;
+  sorted_t::iterator med_it;
+
+  void init(std::string s)
+  {
+    assert(! s.empty());
+    name = std::move(s);
+  }
+
+  /// @return true if @p val is a valid value which is used in the statistics.
+  static bool valid(const double val)
+  {
+    return val == val;
+  }
+
+  /// add @p val with index @p idx to the statistics.
+  /// @p vlo and @p vhi are the minimum and maximum represented by @p val.
+  void add_stats(const double val, const size_t idx, const double vlo, const double vhi)
+  {
+    if (! valid(val))
+      return;
+    ++count;
+    sum += val;
+
+    while(! min_queue.empty() && min_queue.back().second >= vlo)
+      min_queue.pop_back();
+    min_queue.push_back(std::make_pair(idx, vlo));
+    while(! max_queue.empty() && max_queue.back().second <= vhi)
+      max_queue.pop_back();
+    max_queue.push_back(std::make_pair(idx, vhi));
+
+    // keep med_it at index size/2 of the sorted values.
+    // equal values are inserted after existing values.
+    const size_t n = sorted.size();
+    if (n == 0)
+    {
+      med_it = sorted.insert(val);
+      return;
+    }
+    const bool before = val < *med_it;
+    sorted.insert(val);
+    if (n & 1)
+    {
+      if (! before)
+        ++med_it;
+    }
+    else if (before)
+    {
+      --med_it;
+    }
+  }
+
+  /// remove @p val with index @p idx from the statistics.
+  void remove_stats(const double val, const size_t idx)
+  {
+    if (! valid(val))
+      return;
+    assert(count > 0);
+    if (--count == 0)
+    {
+      sum = 0;
+      min_queue.clear();
+      max_queue.clear();
+      sorted.clear();
+      return;
+    }
+    sum -= val;
+
+    if (min_queue.front().first == idx)
+      min_queue.pop_front();
+    if (max_queue.front().first == idx)
+      max_queue.pop_front();
+
+    // keep med_it at index size/2 of the sorted values.
+    const size_t n = sorted.size();
+    if (val < *med_it)
+    {
+      sorted.erase(sorted.find(val));
+      if (n & 1)
+        ++med_it;
+    }
+    else if (val > *med_it)
+    {
+      sorted.erase(sorted.find(val));
+      if (! (n & 1))
+        --med_it;
+    }
+    else
+    {
+      sorted.erase(med_it++);
+      if (! (n & 1))
+        --med_it;
+    }
+
+    if (! std::isfinite(sum))
+    {
+      // an infinite value left the window, sum up the remaining values
+      sum = 0;
+      for(const auto v : sorted)
+        sum += v;
+    }
+  }
+
+  /**
+   * add a value to vec.
+   * @param cgen generation of the value, if generations were skipped since the last
+   *             value, the skipped generations are padded with DOUBLE_MISSING.
+   */
+  void push_back(const double cval, const size_t cgen, const size_t plotwidth, const bool b)
+  {
+    bars = b;
+    if (! quantiles.empty())
+    {
+      sketch.add(cval);
+    }
+    set_window(plotwidth);
+    if (bucket_ms > 0)
+    {
+      add_to_bucket(cval, cgen);
+      return;
+    }
+    catch_up(cgen - 1, plotwidth);
+    push(cval, cgen);
+  }
+
+  /// plot the last @p plotwidth values.
+  void set_window(size_t plotwidth)
+  {
+    if (plotwidth == 0)
+    {
+      plotwidth = 1;
+    }
+    // the buffers only grow when the plot width grows after the screen was resized.
+    if (vec.capacity() < plotwidth)
+    {
+      vec.reserve(plotwidth);
+      const size_t cap = vec.capacity();
+      min_queue.reserve(cap);
+      max_queue.reserve(cap);
+      if (bucket_ms > 0)
+      {
+        lo.reserve(cap);
+        hi.reserve(cap);
+      }
+      for(auto &t : tiers)
+      {
+        t.avg.reserve(cap);
+        t.lo.reserve(cap);
+        t.hi.reserve(cap);
+      }
+    }
+    if (window != plotwidth)
+    {
+      window = plotwidth;
+      rebuild_stats();
+    }
+  }
+
+  /// add the values in the window to the statistics.
+  void rebuild_stats()
+  {
+    count = 0;
+    sum = 0;
+    min_queue.clear();
+    max_queue.clear();
+    sorted.clear();
+    size_t end = vec.size();
+    if (open)
+    {
+      --end;
+    }
+    for(size_t i = vec.size() - std::min(vec.size(), window); i < end; ++i)
+    {
+      const double v = vec[i];
+      add_stats(v, seq - vec.size() + i, (bucket_ms > 0) ? lo[i] : v, (bucket_ms > 0) ? hi[i] : v);
+    }
+  }
+
+  /**
+   * write the values, the aggregated history and the state of rate mode into the record @p r
+   * of a --state file, which has the capacity of vec. Only the values and columns which changed
+   * since the last call are copied, all of them if @p all is true.
+   */
+  void save(state_graph_t &r, const bool all)
+  {
+    const bool bucket = bucket_ms > 0;
+    const size_t mask = r.cap - 1;
+    // the last value of an open bucket and the last column of a tier change until they are complete
+    const size_t first = seq - vec.size();
+    const size_t b = (all || saved_seq > seq) ? first : std::max(first, saved_seq ? saved_seq - 1 : 0);
+    double *rv = r.ring(0);
+    for(size_t i = b; i < seq; ++i)
+    {
+      rv[i & mask] = vec[i - first];
+    }
+    if (bucket)
+    {
+      double *rlo = r.ring(1);
+      double *rhi = r.ring(2);
+      for(size_t i = b; i < seq; ++i)
+      {
+        rlo[i & mask] = lo[i - first];
+        rhi[i & mask] = hi[i - first];
+      }
+    }
+    size_t ri = bucket ? 3 : 1;
+    for(size_t k = 0; k < ZOOM_LEVELS - 1; ++k, ri += 3)
+    {
+      auto &t = tiers[k];
+      const size_t tfirst = t.next - t.avg.size();
+      const size_t tb = (all || t.saved_next > t.next) ? tfirst : std::max(tfirst, t.saved_next ? t.saved_next - 1 : 0);
+      double *ravg = r.ring(ri);
+      double *rlo = r.ring(ri + 1);
+      double *rhi = r.ring(ri + 2);
+      for(size_t c = tb; c < t.next; ++c)
+      {
+        ravg[c & mask] = t.avg[c - tfirst];
+        rlo[c & mask] = t.lo[c - tfirst];
+        rhi[c & mask] = t.hi[c - tfirst];
+      }
+      r.tier[k].columns = t.avg.size();
+      r.tier[k].next = t.next;
+      r.tier[k].sum = t.sum;
+      r.tier[k].n = t.n;
+      t.saved_next = t.next;
+    }
+    r.window = window;
+    r.gen = gen;
+    r.seq = seq;
+    r.values = vec.size();
+    r.pval = pval;
+    r.pts = pts;
+    r.ptd = ptd;
+    r.open = open;
+    r.open_sum = open_sum;
+    r.open_n = open_n;
+    saved_seq = seq;
+  }
+
+  /// read a graph from the record @p r of a --state file.
+  /// The statistics of the window are calculated again, the sketch of --quantiles starts empty.
+  /// @return false if the record is damaged, the graph is empty then.
+  bool load(state_graph_t &r)
+  {
+    clear();
+    const bool bucket = bucket_ms > 0;
+    // the window is at most the capacity of the rings, an open bucket is the last value
+    bool ok = r.cap <= STATE_MAX_VALUES &&
+      (r.cap & (r.cap - 1)) == 0 &&
+      r.window <= r.cap &&
+      r.values <= r.cap &&
+      r.seq >= r.values &&
+      (! r.open || r.values > 0);
+    // the last column of a tier has at most factor values and is not after the last generation
+    size_t factor = 1;
+    for(const auto &t : r.tier)
+    {
+      factor *= ZOOM_FACTOR;
+      ok = ok &&
+        t.columns <= r.cap &&
+        t.columns <= t.next &&
+        t.n <= factor &&
+        t.next <= r.gen / factor + 1 &&
+        (t.n == 0 || t.next > 0) &&
+        (t.next == 0 || t.columns > 0);
+    }
+    if (! ok)
+      return false;
+    set_window(r.cap);
+    const size_t mask = r.cap - 1;
+    const double *rv = r.ring(0);
+    for(size_t i = r.seq - r.values; i < r.seq; ++i)
+    {
+      vec.push_back(rv[i & mask]);
+      if (bucket)
+      {
+        lo.push_back(r.ring(1)[i & mask]);
+        hi.push_back(r.ring(2)[i & mask]);
+      }
+    }
+    size_t ri = bucket ? 3 : 1;
+    for(size_t k = 0; k < ZOOM_LEVELS - 1; ++k, ri += 3)
+    {
+      auto &t = tiers[k];
+      for(size_t c = r.tier[k].next - r.tier[k].columns; c < r.tier[k].next; ++c)
+      {
+        t.avg.push_back(r.ring(ri)[c & mask]);
+        t.lo.push_back(r.ring(ri + 1)[c & mask]);
+        t.hi.push_back(r.ring(ri + 2)[c & mask]);
+      }
+      t.next = t.saved_next = r.tier[k].next;
+      t.sum = r.tier[k].sum;
+      t.n = r.tier[k].n;
+    }
+    pval = r.pval;
+    pts = r.pts;
+    ptd = r.ptd;
+    gen = r.gen;
+    seq = saved_seq = r.seq;
+    open = r.open;
+    open_sum = r.open_sum;
+    open_n = r.open_n;
+    window = r.window;
+    rebuild_stats();
+    return true;
+  }
+
+  /// remove all values, the graph starts again like a new graph.
+  void clear()
+  {
+    vec.clear();
+    lo.clear();
+    hi.clear();
+    for(auto &t : tiers)
+    {
+      t = tier_t();
+    }
+    pval = DOUBLE_UNINIT;
+    pts = 0;
+    ptd = 1;
+    gen = seq = saved_seq = 0;
+    open = false;
+    rebuild_stats();
+  }
+
+  /// add @p cval to the bucket of generation @p cgen.
+  void add_to_bucket(const double cval, size_t cgen)
+  {
+    // a bucket which was already closed does not receive more samples
+    if (cgen < gen)
+    {
+      cgen = gen;
+    }
+    // the last value in vec is the bucket of cgen, it is padded if it is new.
+    catch_up(cgen, window);
+    if (! valid(cval))
+      return;
+    if (! open)
+    {
+      assert(! valid(vec.back()));
+      open = true;
+      open_sum = 0;
+      open_n = 0;
+      lo.back() = hi.back() = cval;
+    }
+    else
+    {
+      ++metrics.bucketed;
+    }
+    open_sum += cval;
+    ++open_n;
+    vec.back() = open_sum / open_n;
+    lo.back() = std::min(lo.back(), cval);
+    hi.back() = std::max(hi.back(), cval);
+  }
+
+  /// add the open bucket to the statistics.
+  void close_bucket()
+  {
+    if (! open)
+      return;
+    open = false;
+    add_stats(vec.back(), seq - 1, lo.back(), hi.back());
+    aggregate(vec.back(), lo.back(), hi.back(), gen);
+  }
+
+  /// pad vec with DOUBLE_MISSING up to generation @p cgen.
+  void catch_up(const size_t cgen, const size_t plotwidth)
+  {
+    set_window(plotwidth);
+    if (gen >= cgen)
+      return;
+    close_bucket();
+    // more padding than vec can hold would only remove the padding values again
+    size_t g = gen;
+    if (cgen - g > vec.capacity())
+    {
+      g = cgen - vec.capacity();
+    }
+    while(g < cgen)
+    {
+      push(DOUBLE_MISSING, ++g);
+    }
+    // the tiers are padded up to the same generation
+    aggregate(DOUBLE_MISSING, DOUBLE_MISSING, DOUBLE_MISSING, gen);
+  }
+
+  /// add @p cval of generation @p cgen to vec, the oldest value is removed if vec is full.
+  void push(const double cval, const size_t cgen)
+  {
+    assert(! open);
+    // the value at the start of the window leaves the statistics
+    if (vec.size() >= window)
+    {
+      const size_t i = vec.size() - window;
+      remove_stats(vec[i], seq - vec.size() + i);
+    }
+    if (vec.size() == vec.capacity())
+    {
+      vec.pop_front();
+      if (bucket_ms > 0)
+      {
+        lo.pop_front();
+        hi.pop_front();
+      }
+    }
+    vec.push_back(cval);
+    if (bucket_ms > 0)
+    {
+      lo.push_back(cval);
+      hi.push_back(cval);
+    }
+    else
+    {
+      // the value is complete, a bucket is complete when it is closed
+      aggregate(cval, cval, cval, cgen);
+    }
+    add_stats(cval, seq++, cval, cval);
+    gen = cgen;
+  }
+
+  /**
+   * add a complete value of vec to the tiers.
+   * @param val value of generation @p cgen.
+   * @param vlo minimum represented by @p val.
+   * @param vhi maximum represented by @p val.
+   */
+  void aggregate(const double val, const double vlo, const double vhi, const size_t cgen)
+  {
+    if (cgen == 0)
+      return;
+    size_t factor = 1;
+    for(auto &t : tiers)
+    {
+      factor *= ZOOM_FACTOR;
+      const size_t col = (cgen - 1) / factor;
+      if (col >= t.next)
+      {
+        // start a new column, skipped columns are padded
+        size_t n = std::min(col - t.next, t.avg.capacity() - 1) + 1;
+        while(n--)
+        {
+          if (t.avg.size() == t.avg.capacity())
+          {
+            t.avg.pop_front();
+            t.lo.pop_front();
+            t.hi.pop_front();
+          }
+          t.avg.push_back(DOUBLE_MISSING);
+          t.lo.push_back(DOUBLE_MISSING);
+          t.hi.push_back(DOUBLE_MISSING);
+        }
+        t.sum = 0;
+        t.n = 0;
+        t.next = col + 1;
+      }
+      if (! valid(val))
+        continue;
+      if (t.n == 0)
+      {
+        t.lo.back() = vlo;
+        t.hi.back() = vhi;
+      }
+      else
+      {
+        t.lo.back() = std::min(t.lo.back(), vlo);
+        t.hi.back() = std::max(t.hi.back(), vhi);
+      }
+      t.sum += val;
+      ++t.n;
+      t.avg.back() = t.sum / t.n;
+    }
+  }
+
+  /**
+   * convert a counter value to a rate value.
+   * @param cval the current counter value.
+   * @param ts time of the value in seconds.
+   * @return the rate, 0 for the first value.
+   */
+  double rate(const double cval, const double ts)
+  {
+    if (pval == DOUBLE_UNINIT)
+    {
+      pval = cval;
+      pts = ts;
+      return 0;
+    }
+    // values with the same time, for example read at once without input timestamps,
+    // use the previous interval
+    double td = ts - pts;
+    if (td > 0)
+    {
+      ptd = td;
+    }
+    else
+    {
+      td = ptd;
+    }
+    pts = ts;
+
+    double r;
+    // detect 32 bit overflow
+    if (pval >= 0xffffff00 &&
+        cval >= 0.0 &&
+        cval < 0xff)
+    {
+      r = cval + (pval - 0xffffff00);
+    }
+    // detect 31 bit overflow
+    else if (pval >= 0x7fffff00 &&
+             pval <= 0x7fffffff &&
+             cval >= 0.0 &&
+             cval < 0xff)
+    {
+      r = cval + (pval - 0x7fffff00);
+    }
+    else
+    {
+      r = cval - pval;
+    }
+    pval = cval;
+    return r / td;
+  }
+
+  /// @return the number of plotted columns of the current zoom level.
+  size_t cols() const
+  {
+    return std::min((zoom > 0) ? tiers[zoom - 1].avg.size() : vec.size(), window);
+  }
+
+  /// calculate min, avg, max, med and the quantiles from the statistics maintained by push_back().
+  /// If zoomed out the statistics are calculated from the plotted columns.
+  void update()
+  {
+    update_stats();
+    if (quantiles.empty())
+      return;
+    qv.resize(quantiles.size());
+    if (all_time)
+    {
+      for(size_t i = 0; i < quantiles.size(); ++i)
+        qv[i] = sketch.quantile(quantiles[i]);
+    }
+    else if (zoom > 0)
+    {
+      // calculated by update_tier()
+    }
+    else if (sorted.empty())
+    {
+      // no closed bucket yet
+      std::fill(qv.begin(), qv.end(), med);
+    }
+    else
+    {
+      // walk the sorted values in the window from the median
+      const size_t m = sorted.size() / 2;
+      for(size_t i = 0; i < quantiles.size(); ++i)
+      {
+        const size_t r = static_cast<size_t>(quantiles[i] * (sorted.size() - 1) + 0.5);
+        auto it = med_it;
+        if (r > m)
+          std::advance(it, r - m);
+        else
+          std::advance(it, -static_cast<long>(m - r));
+        qv[i] = *it;
+      }
+    }
+  }
+
+  void update_stats()
+  {
+    if (zoom > 0)
+    {
+      update_tier(tiers[zoom - 1]);
+      return;
+    }
+    if (open)
+    {
+      // include the open bucket, the median only uses closed buckets
+      const double b = vec.back();
+      if (count == 0)
+      {
+        min = lo.back();
+        max = hi.back();
+        avg = med = b;
+        return;
+      }
+      min = std::min(min_queue.front().second, lo.back());
+      max = std::max(max_queue.front().second, hi.back());
+      avg = (sum + b) / (count + 1);
+      med = *med_it;
+      return;
+    }
+    if (count == 0)
+    {
+      min = max = avg = med = 0.0;
+      return;
+    }
+    min = min_queue.front().second;
+    max = max_queue.front().second;
+    avg = sum / count;
+    med = *med_it;
+  }
+
+  /// calculate min, avg, max, med of the plotted columns of @p t.
+  void update_tier(const tier_t &t)
+  {
+    const size_t b = t.avg.size() - cols();
+    const size_t e = t.avg.size();
+    double s = 0;
+    size_t n = 0;
+    t.avg.spans(b, e, [&](const double *p, const size_t len) {
+        n += sum_valid(p, len, s);
+      });
+    if (n == 0)
+    {
+      min = max = avg = med = 0.0;
+      qv.assign(quantiles.size(), 0.0);
+      return;
+    }
+    avg = s / n;
+    // lo and hi are missing in the same columns as avg
+    min = INFINITY;
+    max = -INFINITY;
+    t.lo.spans(b, e, [&](const double *p, const size_t len) {
+        min = min_valid(p, len, min);
+      });
+    t.hi.spans(b, e, [&](const double *p, const size_t len) {
+        max = max_valid(p, len, max);
+      });
+    static std::vector<double> avgs;
+    avgs.clear();
+    t.avg.spans(b, e, [&](const double *p, const size_t len) {
+        avgs.insert(avgs.end(), p, p + len);
+      });
+    avgs.erase(std::remove_if(avgs.begin(), avgs.end(), [](const double v) { return ! valid(v); }), avgs.end());
+    std::nth_element(avgs.begin(), avgs.begin() + avgs.size()/2, avgs.end());
+    med = avgs[avgs.size()/2];
+    if (all_time)
+      return;
+    qv.resize(quantiles.size());
+    for(size_t i = 0; i < quantiles.size(); ++i)
+    {
+      const size_t r = static_cast<size_t>(quantiles[i] * (avgs.size() - 1) + 0.5);
+      std::nth_element(avgs.begin(), avgs.begin() + r, avgs.end());
+      qv[i] = avgs[r];
+    }
+  }
+
+  /**
+   * plot the columns with index [x_begin, x_end) of the current zoom level into screen
+   * columns [x_begin+1, x_end+1).
+   * Each column only depends on its value and the value left of it.
+   */
+  void plot(const size_t x_begin,
+            const size_t x_end,
+            const int plotheight,
+            const double global_max,
+            const double global_min,
+            const char max_errchar,
+            const char min_errchar,
+            const double hardmax) const
+  {
+    plot(x_begin, x_end, plotheight, global_max, global_min, max_errchar, min_errchar, hardmax, draw_line);
+  }
+
+  /**
+   * plot the values with index [x_begin, x_end) with @p draw_line,
+   * which is called like ::draw_line() with the screen column, two rows and the plot character.
+   */
+  template<typename Line>
+  void plot(size_t x_begin,
+            size_t x_end,
+            const int plotheight,
+            const double global_max,
+            const double global_min,
+            const char max_errchar,
+            const char min_errchar,
+            const double hardmax,
+            const Line &draw_line) const
+  {
+    if (x_end > cols())
+    {
+      x_end = cols();
+    }
+    if (x_begin >= x_end)
+    {
+      return;
+    }
+    // the columns of the zoom level, if zoomed out or in bucket mode each column
+    // is drawn with its minimum and maximum.
+    const ring_t<double> *v = &vec, *l = &lo, *h = &hi;
+    if (zoom > 0)
+    {
+      v = &tiers[zoom - 1].avg;
+      l = &tiers[zoom - 1].lo;
+      h = &tiers[zoom - 1].hi;
+    }
+    const bool envelope = zoom > 0 || bucket_ms > 0;
+    // index of the value plotted in column 0
+    const size_t first = v->size() - cols();
+
+    const double mymax = global_max - global_min;
+    // screen row and plot character of the value at index x
+    auto row = [&](const double val, char &pc) {
+      // check for min and max
+      if (val >= hardmax)
+      {
+        pc = max_errchar;
+        return 0;
+      }
+      if (val <= global_min)
+      {
+        pc = min_errchar;
+        return plotheight - 1;
+      }
+      // regular point
+      pc = name[0];
+      const int y = plotheight - static_cast<int>((val-global_min) / mymax * plotheight) - 1;
+      return (y < 0) ? 0 : y;
+    };
+
+    // y screen coordinate of previous row
+    int lasty = INT_UNINIT;
+    if (x_begin > 0 &&
+        valid((*v)[first + x_begin - 1]))
+    {
+      char pc;
+      lasty = row((*v)[first + x_begin - 1], pc);
+    }
+
+    for(size_t x = x_begin; x < x_end; ++x)
+    {
+      const auto val = (*v)[first + x];
+      // skip missing points
+      if (! valid(val))
+      {
+        lasty = INT_UNINIT;
+        continue;
+      }
+      char pc;  // plot character
+      const int y = row(val, pc);  // y coordinate of the value
+      if (envelope)
+      {
+        // draw the envelope of the column, bars are drawn up to the maximum
+        char lo_pc, hi_pc;
+        const int lo_y = row((*l)[first + x], lo_pc);
+        const int hi_y = row((*h)[first + x], hi_pc);
+        if (bars)
+        {
+          draw_line(x+1, plotheight, hi_y, pc);
+        }
+        else
+        {
+          if (lasty != INT_UNINIT)
+          {
+            draw_line(x+1, lasty, y, pc);
+          }
+          draw_line(x+1, hi_y, lo_y + 1, pc);
+        }
+        // mark values outside of the plot range
+        if (hi_pc != name[0])
+        {
+          draw_line(x+1, hi_y, hi_y, hi_pc);
+        }
+        if (lo_pc != name[0])
+        {
+          draw_line(x+1, lo_y, lo_y, lo_pc);
+        }
+        lasty = y;
+        continue;
+      }
+      // adjust lasty to draw a bar or a point
+      if (bars)
+      {
+        lasty = plotheight;
+      }
+      else if (lasty == INT_UNINIT)
+      {
+        lasty = y;
+      }
+      // draw
+      draw_line(x+1, lasty, y, pc);
+      lasty = y;
+    }
+  }
+
+  /// @return the value up to which the bar in column @p x is drawn, -INFINITY if the value is missing.
+  double bar(const size_t x) const
+  {
+    if (x >= cols())
+      return -INFINITY;
+    const ring_t<double> *v = &vec, *h = &hi;
+    if (zoom > 0)
+    {
+      v = &tiers[zoom - 1].avg;
+      h = &tiers[zoom - 1].hi;
+    }
+    const size_t i = v->size() - cols() + x;
+    if (! valid((*v)[i]))
+      return -INFINITY;
+    return (zoom > 0 || bucket_ms > 0) ? (*h)[i] : (*v)[i];
+  }
+
+  /**
+   * calculate the spectrum of the last fft.n values for -F if @p every values were added since
+   * it was calculated the last time. Missing values and the values before the first value
+   * are replaced by the average.
+   * @return true if the spectrum was calculated.
+   */
+  bool update_spectrum(fft_t &fft, const size_t every)
+  {
+    if (spectrum.size() == fft.n / 2 + 1 &&
+        seq - spectrum_seq < every)
+      return false;
+    spectrum_seq = seq;
+    const size_t n = std::min(vec.size(), fft.n);
+    const size_t first = vec.size() - n;
+    double s = 0;
+    size_t c = 0;
+    for(size_t i = first; i < vec.size(); ++i)
+    {
+      if (valid(vec[i]))
+      {
+        s += vec[i];
+        ++c;
+      }
+    }
+    const double fill = c ? s / c : 0;
+    const size_t pad = fft.n - n;
+    std::fill_n(fft.re.begin(), pad, fill);
+    for(size_t i = 0; i < n; ++i)
+    {
+      const double v = vec[first + i];
+      fft.re[pad + i] = valid(v) ? v : fill;
+    }
+    fft.amplitudes(spectrum);
+    return true;
+  }
+
+  /// draw the spectrum of -F as bars in the screen columns [1, @p cols], the frequencies are spread over the columns.
+  void plot_spectrum(const int cols,
+                     const int plotheight,
+                     const double global_max,
+                     const double global_min,
+                     const char max_errchar,
+                     const double hardmax) const
+  {
+    if (spectrum.size() < 2)
+      return;
+    const size_t bins = spectrum.size() - 1;
+    const double mymax = global_max - global_min;
+    for(int x = 0; x < cols; ++x)
+    {
+      const double a = spectrum[1 + x * bins / cols];
+      if (a <= global_min)
+        continue;
+      if (a >= hardmax)
+      {
+        draw_line(x+1, plotheight, 0, max_errchar);
+        continue;
+      }
+      const int y = plotheight - static_cast<int>((a-global_min) / mymax * plotheight) - 1;
+      draw_line(x+1, plotheight, (y < 0) ? 0 : y, name[0]);
+    }
+  }
+
+  /**
+   * print the name and statistics below the plot.
+   * before calling details(), update() should be called.
+   * @param idx index of plot that is drawn.
+   */
+  void details(const unsigned idx,
+               const int screenwidth,
+               const int plotheight)
+  {
+    // calculate screen position of details
+    int x, y;
+    if (screenwidth < SCREENWIDTH_FOR_2COLUMN)
+    {
+      x = 0;
+      y = plotheight + idx + 1;
+    }
+    else
+    {
+      x = (idx & 1) * SCREENWIDTH_FOR_2COLUMN / 2;
+      y = plotheight + idx/2 + 1;
+    }
+    // print the detail name
+    if (name[0] == CHAR_REVERSE &&
+        name.size() == 1)
+    {
+      const int a = fb.attr;
+      fb.attr |= A_REVERSE;
+      fb.put(y, x++, CHAR_REVERSE);
+      fb.attr = a;
+    }
+    else
+    {
+      x = fb.text(y, x, name.c_str());
+    }
+    // print details, the line is only formatted again if the statistics changed
+    const double stats[] = {last(), min, max, avg, med};
+    if (detail_line.empty() ||
+        ! std::equal(stats, stats + 5, detail_stats) ||
+        detail_qv != qv)
+    {
+      std::copy(stats, stats + 5, detail_stats);
+      detail_qv = qv;
+      detail_line.clear();
+      const auto value = [this](const char *label, const double d) {
+        char buf[FORMAT_SIZE];
+        detail_line += label;
+        detail_line.append(buf, format_fixed(buf, d, 1));
+      };
+      value(" last=", stats[0]);
+      value(" min=", stats[1]);
+      value(" max=", stats[2]);
+      value(" avg=", stats[3]);
+      if (quantiles.empty())
+      {
+        value(" med=", med);
+      }
+      for(size_t i = 0; i < quantiles.size(); ++i)
+      {
+        char label[FORMAT_SIZE];
+        snprintf(label, sizeof(label), " p%g=", quantiles[i] * 100);
+        value(label, (i < qv.size()) ? qv[i] : 0.0);
+      }
+      detail_line += ' ';
+    }
+    fb.text(y, x, detail_line.c_str());
+  }
+
+  /// what ranks the graphs for --top
+  enum rank_t {
+    RANK_LAST, RANK_AVG, RANK_MAX
+  };
+
+  /// @return the value which ranks the graph for --top from the statistics maintained by push_back(),
+  ///         so update() is not needed.
+  double rank(const rank_t by) const
+  {
+    if (count == 0)
+      return -INFINITY;
+    if (by == RANK_LAST)
+      return last();
+    if (by == RANK_AVG)
+      return sum / count;
+    return max_queue.front().second;
+  }
+
+  /// @return last valid value.
+  /// @return 0 if no valid value is found.
+  double last() const
+  {
+    for(size_t i = vec.size(); i > 0; --i)
+    {
+      if (valid(vec[i - 1]))
+      {
+        return vec[i - 1];
+      }
+    }
+    return 0;
+  }
+};
+
+size_t values_t::bucket_ms = 0;
+unsigned values_t::zoom = 0;
+std::vector<double> values_t::quantiles;
+bool values_t::all_time = false;
+
+/// table of graphs.
+/// Graphs are found by key with an open addressing hash index and have a dense id
+/// in the order they were created.
+/// @tparam T graph type with a key member and an init() function.
+template<typename T>
+class table_t
+{
+  // graphs by id, a deque keeps the T objects at the same address
+  std::deque<T> vals;
+  // ids in alphabetical order of the keys, which is the order the graphs are drawn
+  std::vector<size_t> order;
+  // hash index, size is a power of two
+  struct slot_t
+  {
+    uint32_t hash;
+    uint32_t id;  ///< EMPTY if the slot is not used
+  };
+  static const uint32_t EMPTY = UINT32_MAX;
+  std::vector<slot_t> slots;
+
+  static uint32_t hash(const char *k, const size_t len)
+  {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for(size_t i = 0; i < len; ++i)
+    {
+      h ^= static_cast<unsigned char>(k[i]);
+      h *= 16777619u;
+    }
+    return h;
+  }
+
+  void insert_slot(const uint32_t h, const uint32_t id)
+  {
+    const size_t mask = slots.size() - 1;
+    size_t i = h & mask;
+    while(slots[i].id != EMPTY)
+    {
+      i = (i + 1) & mask;
+    }
+    slots[i].hash = h;
+    slots[i].id = id;
+  }
+
+public:
+  static const size_t npos = SIZE_MAX;
+
+  size_t size() const { return vals.size(); }
+  T& operator[](const size_t id) { return vals[id]; }
+  const T& operator[](const size_t id) const { return vals[id]; }
+  /// @return the ids of all graphs in drawing order.
+  const std::vector<size_t>& sorted() const { return order; }
+
+  /// @return the id of the graph with key @p k, or npos.
+  size_t find(const char *k, const size_t len) const
+  {
+    if (slots.empty())
+      return npos;
+    const uint32_t h = hash(k, len);
+    const size_t mask = slots.size() - 1;
+    for(size_t i = h & mask; slots[i].id != EMPTY; i = (i + 1) & mask)
+    {
+      if (slots[i].hash != h)
+        continue;
+      const auto &key = vals[slots[i].id].key;
+      if (key.size() == len &&
+          memcmp(key.data(), k, len) == 0)
+      {
+        return slots[i].id;
+      }
+    }
+    return npos;
+  }
+
+  /// @return the id of the graph with key @p k, a new graph is created if needed.
+  size_t id(const char *k, const size_t len)
+  {
+    assert(len > 0);
+    auto id = find(k, len);
+    if (id != npos)
+      return id;
+    id = vals.size();
+    vals.emplace_back();
+    auto &val = vals.back();
+    val.key.assign(k, len);
+    val.init(val.key);
+    // keep the load factor at most 1/2
+    if (slots.size() < vals.size() * 2)
+    {
+      std::vector<slot_t> old;
+      old.swap(slots);
+      slot_t e;
+      e.hash = 0;
+      e.id = EMPTY;
+      slots.assign(std::max<size_t>(16, old.size() * 2), e);
+      for(const auto &o : old)
+      {
+        if (o.id != EMPTY)
+          insert_slot(o.hash, o.id);
+      }
+    }
+    insert_slot(hash(k, len), id);
+    // insert into drawing order
+    auto it = std::lower_bound(order.begin(), order.end(), val.key, [this](const size_t a, const std::string &b) {
+        return vals[a].key < b;
+      });
+    order.insert(it, id);
+    return id;
+  }
+
+  T& operator[](const std::string &k)
+  {
+    return vals[id(k.data(), k.size())];
+  }
+
+  void clear()
+  {
+    vals.clear();
+    order.clear();
+    slots.clear();
+  }
+
+  /// remove the graphs with an id of @p n or larger.
+  void truncate(const size_t n)
+  {
+    if (n >= vals.size())
+      return;
+    vals.resize(n);
+    order.erase(std::remove_if(order.begin(), order.end(), [n](const size_t id) {
+          return id >= n;
+        }), order.end());
+    // the index is built again, so no removed slot ends the search for a key
+    std::vector<slot_t> old;
+    old.swap(slots);
+    slot_t e;
+    e.hash = 0;
+    e.id = EMPTY;
+    slots.assign(old.size(), e);
+    for(const auto &o : old)
+    {
+      if (o.id < n)
+        insert_slot(o.hash, o.id);
+    }
+  }
+};
+
+typedef table_t<values_t> values_table_t;
+values_table_t values;
+/**
+ * add a value to the graph @p id.
+ * @param rate if true the value is a counter which is converted to a rate.
+ * @param ts time of the value in seconds, used in rate mode.
+ */
+void
+push_back(const size_t id, const double v, const size_t gen, const size_t plotwidth, const bool bars, const bool rate, const double ts)
+{
+  auto &val = values[id];
+  val.push_back(rate ? val.rate(v, ts) : v, gen, plotwidth, bars);
+  ++val.samples;
+  ++metrics.samples;
+}
+
+/// state of the plot which --state keeps besides the graphs
+struct state_t
+{
+  // options which change the meaning of the values, a file written with other options is not read
+  uint32_t options = 0;
+  // generation of the last sample and the time in seconds since the epoch when it was written
+  size_t gen = 0;
+  double time = 0;
+  // scale of the plot, which only grows without --autoscale
+  double global_max = DOUBLE_MIN;
+  double global_min = DOUBLE_MAX;
+  // in rate mode the time of the previous sample and the interval shown on the screen
+  double t1 = DOUBLE_UNINIT;
+  double td = 1;
+};
+
+/**
+ * --state file mapped into memory. A graph keeps its record, so save() only writes the values
+ * and columns which changed since the last save() instead of the whole file.
+ * A graph whose capacity changed is moved to a new record at the end of the file, the file is
+ * written again when the moved records take more than half of it.
+ */
+struct state_map_t
+{
+  static const size_t npos = SIZE_MAX;
+
+  int fd = -1;
+  char *map = NULL;
+  // size of the file and the mapping
+  size_t len = 0;
+  // name, device and inode of the mapped file, which is written again if it was replaced
+  std::string fn;
+  dev_t dev = 0;
+  ino_t ino = 0;
+  // offset of the record of each graph id, npos if the graph has no record
+  std::vector<size_t> offsets;
+  // bytes of the moved records
+  size_t unused = 0;
+
+  ~state_map_t()
+  {
+    close();
+  }
+
+  state_header_t& header()
+  {
+    return *reinterpret_cast<state_header_t*>(map);
+  }
+
+  state_graph_t& record(const size_t off)
+  {
+    return *reinterpret_cast<state_graph_t*>(map + off);
+  }
+
+  /// unmap and close the file.
+  void close()
+  {
+    if (map)
+    {
+      munmap(map, len);
+    }
+    if (fd >= 0)
+    {
+      ::close(fd);
+    }
+    fd = -1;
+    map = NULL;
+    len = 0;
+    fn.clear();
+    offsets.clear();
+    unused = 0;
+  }
+
+  /// change the size of the file to @p n bytes and map it again.
+  /// @return false on error with errno set, the file is closed then.
+  bool resize(const size_t n)
+  {
+    if (map)
+    {
+      munmap(map, len);
+      map = NULL;
+    }
+    void *m = MAP_FAILED;
+    if (ftruncate(fd, n) == 0)
+    {
+      m = mmap(NULL, n, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (m == MAP_FAILED)
+    {
+      const int e = errno;
+      close();
+      errno = e;
+      return false;
+    }
+    map = static_cast<char*>(m);
+    len = n;
+    return true;
+  }
+
+  /// write all values of graph @p id into a new record at the end of the file.
+  /// @return false on error with errno set, the file is closed then.
+  bool append(const size_t id)
+  {
+    auto &val = values[id];
+    const size_t cap = val.vec.capacity();
+    const size_t bytes = state_graph_t::bytes(val.key.size(), cap, values_t::bucket_ms > 0);
+    const size_t off = header().used;
+    // the file grows by half, so a graph after another is not mapped again every time
+    if (off + bytes > len &&
+        ! resize(std::max(off + bytes, len + len / 2)))
+      return false;
+    auto &r = record(off);
+    r.size = bytes;
+    r.moved = 0;
+    r.key_size = val.key.size();
+    r.cap = cap;
+    memcpy(r.key(), val.key.data(), val.key.size());
+    val.save(r, true);
+    header().used = off + bytes;
+    offsets[id] = off;
+    return true;
+  }
+
+  /// write the state of the plot besides the graphs into the header.
+  void put(const state_t &s)
+  {
+    auto &h = header();
+    h.gen = s.gen;
+    h.time = s.time;
+    h.global_max = s.global_max;
+    h.global_min = s.global_min;
+    h.t1 = s.t1;
+    h.td = s.td;
+  }
+
+  /// write @p s and all graphs to @p name.tmp, which is renamed to @p name and stays mapped.
+  /// @return false on error with errno set.
+  bool rewrite(const char *name, const state_t &s)
+  {
+    close();
+    const bool bucket = values_t::bucket_ms > 0;
+    size_t bytes = sizeof(state_header_t);
+    for(size_t id = 0; id < values.size(); ++id)
+    {
+      bytes += state_graph_t::bytes(values[id].key.size(), values[id].vec.capacity(), bucket);
+    }
+    const std::string tmp = std::string(name) + ".tmp";
+    fd = open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0)
+      return false;
+    bool ok = resize(bytes);
+    if (ok)
+    {
+      auto &h = header();
+      h.magic = STATE_MAGIC;
+      h.version = STATE_VERSION;
+      h.options = s.options;
+      h.clean = 0;
+      h.bucket_ms = values_t::bucket_ms;
+      h.used = sizeof(state_header_t);
+      offsets.assign(values.size(), npos);
+      for(size_t id = 0; ok && id < values.size(); ++id)
+      {
+        ok = append(id);
+      }
+    }
+    struct stat st;
+    if (ok)
+    {
+      put(s);
+      header().clean = 1;
+      ok = fstat(fd, &st) == 0 &&
+        rename(tmp.c_str(), name) == 0;
+    }
+    if (! ok)
+    {
+      const int e = errno;
+      close();
+      unlink(tmp.c_str());
+      errno = e;
+      return false;
+    }
+    fn = name;
+    dev = st.st_dev;
+    ino = st.st_ino;
+    return true;
+  }
+
+  /**
+   * write @p s and the values and columns of the graphs which changed since the last save()
+   * to @p name. While the records are written the header is not clean, so the file of
+   * a ttyplot which is killed then is not read.
+   * @return false on error with errno set.
+   */
+  bool save(const char *name, const state_t &s)
+  {
+    struct stat st;
+    // a graph which was removed from the table leaves a record
+    if (! map ||
+        fn != name ||
+        stat(name, &st) != 0 ||
+        st.st_dev != dev ||
+        st.st_ino != ino ||
+        values.size() < offsets.size() ||
+        unused > header().used / 2)
+    {
+      return rewrite(name, s);
+    }
+    header().clean = 0;
+    offsets.resize(values.size(), npos);
+    for(size_t id = 0; id < values.size(); ++id)
+    {
+      auto &val = values[id];
+      if (offsets[id] == npos)
+      {
+        if (! append(id))
+          return false;
+        continue;
+      }
+      auto &r = record(offsets[id]);
+      // the table was cleared and filled with other graphs
+      if (r.key_size != val.key.size() ||
+          memcmp(r.key(), val.key.data(), r.key_size) != 0)
+      {
+        return rewrite(name, s);
+      }
+      if (r.cap != val.vec.capacity())
+      {
+        r.moved = 1;
+        unused += r.size;
+        if (! append(id))
+          return false;
+        continue;
+      }
+      val.save(r, false);
+    }
+    put(s);
+    header().clean = 1;
+    return true;
+  }
+
+  /**
+   * read the graphs and @p s from @p name which was written by save() with the same s.options.
+   * The file stays mapped if it is writable.
+   * @return false if name could not be read with errno set, or with errno 0 if name was written
+   *         with other options or is damaged. The graphs are empty then.
+   */
+  bool load(const char *name, state_t &s)
+  {
+    close();
+    bool writable = true;
+    fd = open(name, O_RDWR);
+    if (fd < 0 &&
+        (errno == EACCES || errno == EROFS))
+    {
+      writable = false;
+      fd = open(name, O_RDONLY);
+    }
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+      const int e = errno;
+      close();
+      errno = e;
+      return false;
+    }
+    bool ok = static_cast<size_t>(st.st_size) >= sizeof(state_header_t);
+    if (ok)
+    {
+      void *m = mmap(NULL, st.st_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+      if (m == MAP_FAILED)
+      {
+        const int e = errno;
+        close();
+        errno = e;
+        return false;
+      }
+      map = static_cast<char*>(m);
+      len = st.st_size;
+    }
+    const bool bucket = values_t::bucket_ms > 0;
+    // graphs of the options, the other graphs are created by the file
+    const size_t existing = values.size();
+    offsets.assign(existing, npos);
+    ok = ok &&
+      header().magic == STATE_MAGIC &&
+      header().version == STATE_VERSION &&
+      header().options == s.options &&
+      header().bucket_ms == values_t::bucket_ms &&
+      header().clean == 1 &&
+      header().used >= sizeof(state_header_t) &&
+      header().used <= len;
+    for(size_t off = sizeof(state_header_t); ok && off < header().used; )
+    {
+      const size_t left = header().used - off;
+      ok = left >= sizeof(state_graph_t);
+      if (! ok)
+        break;
+      auto &r = record(off);
+      ok = r.key_size > 0 &&
+        r.key_size <= STATE_MAX_VALUES &&
+        r.cap <= STATE_MAX_VALUES &&
+        r.size == state_graph_t::bytes(r.key_size, r.cap, bucket) &&
+        r.size <= left;
+      if (! ok)
+        break;
+      off += r.size;
+      if (r.moved)
+      {
+        unused += r.size;
+        continue;
+      }
+      const size_t id = values.id(r.key(), r.key_size);
+      offsets.resize(values.size(), npos);
+      // a graph has one record
+      ok = offsets[id] == npos &&
+        values[id].load(r);
+      offsets[id] = off - r.size;
+    }
+    if (! ok)
+    {
+      values.truncate(existing);
+      for(size_t id = 0; id < values.size(); ++id)
+      {
+        values[id].clear();
+      }
+      const auto options = s.options;
+      s = state_t();
+      s.options = options;
+      close();
+      errno = 0;
+      return false;
+    }
+    const auto &h = header();
+    s.gen = h.gen;
+    s.time = h.time;
+    s.global_max = h.global_max;
+    s.global_min = h.global_min;
+    s.t1 = h.t1;
+    s.td = h.td;
+    if (! writable)
+    {
+      close();
+      return true;
+    }
+    fn = name;
+    dev = st.st_dev;
+    ino = st.st_ino;
+    return true;
+  }
+};
+
+const size_t state_map_t::npos;
+state_map_t state_map;
+
+/// write @p s and the graphs to @p fn for --state, see state_map_t::save().
+/// @return false on error with errno set.
+bool
+save_state(const char *fn, const state_t &s)
+{
+  return state_map.save(fn, s);
+}
+
+/// read the graphs and @p s from @p fn for --state, see state_map_t::load().
+/// @return false if fn could not be read with errno set, or with errno 0 if fn was written
+///         with other options or is damaged. The graphs are empty then.
+bool
+load_state(const char *fn, state_t &s)
+{
+  return state_map.load(fn, s);
+}
+
+/// output formats of --headless
+enum class Headless {
+  NONE, CSV, JSON
+};
+
+/// print @p s quoted if needed for the @p format.
+void
+print_string(FILE *f, const Headless format, const std::string &s)
+{
+  if (format == Headless::CSV &&
+      s.find_first_of(",\"\r\n") == std::string::npos)
+  {
+    fputs(s.c_str(), f);
+    return;
+  }
+  fputc('"', f);
+  for(const char c : s)
+  {
+    if (format == Headless::CSV)
+    {
+      if (c == '"')
+        fputc('"', f);
+      fputc(c, f);
+    }
+    else if (c == '"' || c == '\\')
+    {
+      fprintf(f, "\\%c", c);
+    }
+    else if (static_cast<unsigned char>(c) < 0x20)
+    {
+      fprintf(f, "\\u%04x", c);
+    }
+    else
+    {
+      fputc(c, f);
+    }
+  }
+  fputc('"', f);
+}
+
+/// print the column names of the --headless @p format.
+void
+headless_header(FILE *f, const Headless format)
+{
+  if (format != Headless::CSV)
+    return;
+  fputs("time,key,samples,last,min,max,avg", f);
+  if (values_t::quantiles.empty())
+  {
+    fputs(",med", f);
+  }
+  for(const auto q : values_t::quantiles)
+  {
+    fprintf(f, ",p%g", q * 100);
+  }
+  fputc('\n', f);
+  fflush(f);
+}
+
+/**
+ * print the statistics of all graphs for --headless, which are the details
+ * of a plot with HEADLESS_WIDTH columns: CSV has one line for each graph,
+ * JSON has one object with all graphs.
+ * @param t time of the summary in seconds since the epoch.
+ */
+void
+headless_summary(FILE *f, const Headless format, const double t)
+{
+  const bool csv = format == Headless::CSV;
+  if (! csv)
+  {
+    fprintf(f, "{\"time\":%.3f,\"graphs\":{", t);
+  }
+  bool first = true;
+  for(const auto id : values.sorted())
+  {
+    auto &vals = values[id];
+    vals.update();
+    if (csv)
+    {
+      fprintf(f, "%.3f,", t);
+    }
+    else if (! first)
+    {
+      fputc(',', f);
+    }
+    first = false;
+    print_string(f, format, vals.key);
+    // the statistics are empty if the window has no valid values
+    const bool empty = vals.count == 0 && ! vals.open;
+    fprintf(f, csv ? ",%zu" : ":{\"samples\":%zu", vals.samples);
+    vals.samples = 0;
+    auto print = [&](const char *name, const double v) {
+      if (csv)
+        fprintf(f, empty ? "," : ",%.10g", v);
+      else
+        fprintf(f, empty ? ",\"%s\":null" : ",\"%s\":%.10g", name, v);
+    };
+    print("last", vals.last());
+    print("min", vals.min);
+    print("max", vals.max);
+    print("avg", vals.avg);
+    if (values_t::quantiles.empty())
+    {
+      print("med", vals.med);
+    }
+    for(size_t i = 0; i < values_t::quantiles.size(); ++i)
+    {
+      char name[32];
+      snprintf(name, sizeof(name), "p%g", values_t::quantiles[i] * 100);
+      print(name, vals.qv[i]);
+    }
+    fputs(csv ? "\n" : "}", f);
+  }
+  if (! csv)
+  {
+    fputs("}}\n", f);
+  }
+  fflush(f);
+}
+
+int
+parseColors(const std::string &color_str)
+{
+  if (color_str.empty())
+    return -1;
+  bool ret = true;
+  int parsed_colors = 0;
+  std::istringstream is(color_str);
+  while(is)
+  {
+    std::string col_str;
+    if (is >> col_str)
+    {
+      int col = -1;
+      if (col_str == "black" ||
+          col_str == "blk" ||
+          col_str == "bk")
+      {
+        col = COLOR_BLACK;
+      }
+      else if (col_str == "red" ||
+               col_str == "rd")
+      {
+        col = COLOR_RED;
+      }
+      else if (col_str == "green" ||
+               col_str == "grn" ||
+               col_str == "gr")
+      {
+        col = COLOR_GREEN;
+      }
+      else if (col_str == "yellow" ||
+               col_str == "yel" ||
+               col_str == "yl")
+      {
+        col = COLOR_YELLOW;
+      }
+      else if (col_str == "blue" ||
+               col_str == "blu" ||
+               col_str == "bl")
+      {
+        col = COLOR_BLUE;
+      }
+      else if (col_str == "magenta" ||
+               col_str == "mag" ||
+               col_str == "mg")
+      {
+        col = COLOR_MAGENTA;
+      }
+      else if (col_str == "cyan" ||
+               col_str == "cyn" ||
+               col_str == "cy" ||
+               col_str == "cn")
+      {
+        col = COLOR_CYAN;
+      }
+      else if (col_str == "white" ||
+               col_str == "wht" ||
+               col_str == "wh")
+      {
+        col = COLOR_WHITE;
+      }
+      else
+      {
+        printf("unknown color: %s\n", col_str.c_str());
+        ret = false;
+        continue;
+      }
+      assert(col >= 0);
+      pair_colors.push_back(col);
+      ++parsed_colors;
+      // \todo get default background color
+      if (sp)
+      {
+        int res = init_pair(parsed_colors, col, COLOR_BLACK);
+        assert(res == OK);
+      }
+    }
+  }
+  if (! ret)
+  {
+    exit(EXIT_FAILURE);
+  }
+  return parsed_colors;
+}
+
+/**
+ * parse a decimal floating point number in [b, e) like strtod() in the C locale.
+ * Numbers with up to 15 significant digits and small exponents are converted
+ * exactly without calling strtod(). Other numbers, hex numbers, inf and nan are
+ * passed to strtod(), the character at @p e must be writable for that.
+ * @param[out] end set to the first character after the number.
+ * @return true if a number was parsed.
+ */
+bool
+parse_double(char *b, char *e, double &v, char *&end)
+{
+  static const double pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  char *p = b;
+  bool neg = false;
+  if (p < e && (*p == '-' || *p == '+'))
+  {
+    neg = *p++ == '-';
+  }
+  uint64_t m = 0;
+  int digits = 0;  // significant digits in m
+  int exp10 = 0;
+  bool have_digits = false;
+  for(; p < e && *p >= '0' && *p <= '9'; ++p)
+  {
+    have_digits = true;
+    if (m == 0 && *p == '0')
+      continue;
+    m = m * 10 + (*p - '0');
+    ++digits;
+  }
+  if (p < e && *p == '.')
+  {
+    for(++p; p < e && *p >= '0' && *p <= '9'; ++p)
+    {
+      have_digits = true;
+      --exp10;
+      if (m == 0 && *p == '0')
+        continue;
+      m = m * 10 + (*p - '0');
+      ++digits;
+    }
+  }
+  if (! have_digits)
+  {
+    // inf, nan or garbage
+    goto slow;
+  }
+  if (p < e && (*p == 'e' || *p == 'E'))
+  {
+    char *q = p + 1;
+    bool eneg = false;
+    if (q < e && (*q == '-' || *q == '+'))
+    {
+      eneg = *q++ == '-';
+    }
+    if (q < e && *q >= '0' && *q <= '9')
+    {
+      int x = 0;
+      for(; q < e && *q >= '0' && *q <= '9'; ++q)
+      {
+        if (x < 10000)
+          x = x * 10 + (*q - '0');
+      }
+      exp10 += eneg ? -x : x;
+      p = q;
+    }
+  }
+  else if (p < e &&
+           (*p == 'x' || *p == 'X') &&
+           m == 0 &&
+           digits == 0)
+  {
+    // hex number
+    goto slow;
+  }
+  if (digits > 15 ||
+      exp10 < -22 ||
+      exp10 > 22)
+  {
+    goto slow;
+  }
+  v = static_cast<double>(m);
+  if (exp10 < 0)
+    v /= pow10[-exp10];
+  else
+    v *= pow10[exp10];
+  if (neg)
+    v = -v;
+  end = p;
+  return true;
+
+ slow:
+  const char c = *e;
+  *e = 0;
+  v = strtod(b, &end);
+  *e = c;
+  return end != b;
+}
+
+/// buffered reader for the data input.
+/// Input is read with read(2) after waiting with poll(2), so the main loop
+/// can wait for data and for the next screen refresh at the same time.
+/// A recorded file is mapped into memory with map() instead.
+/// Samples are parsed in place in the buffer without copying.
+struct input_t
+{
+  enum result_t {
+    PARSED,   ///< a sample was parsed
+    INVALID,  ///< input could not be parsed, the rest of the line is skipped
+    MORE,     ///< not enough data buffered to parse a sample
+    END       ///< end of input
+  };
+
+  int fd = STDIN_FILENO;
+  // data read from fd.
+  // one extra byte is reserved to terminate the last token at end of input.
+  std::vector<char> buf = std::vector<char>(256 * 1024 + 1);
+  // the input, buf or a file mapped into memory. unparsed data is in data[pos, len).
+  char *data = buf.data();
+  // size of the memory mapping, 0 if the input is read into buf
+  size_t map_len = 0;
+  size_t pos = 0;
+  size_t len = 0;
+  // true if read() returned end of file
+  bool eof = false;
+  // true if input up to the next newline character is skipped
+  bool skip_line = false;
+
+  ~input_t()
+  {
+    if (map_len > 0)
+    {
+      munmap(data, map_len);
+    }
+  }
+
+  /**
+   * map the regular file @p fd into memory, so it is parsed without copying.
+   * @return false if the file could not be mapped, then it is read with fill().
+   */
+  bool map(const int fd)
+  {
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        ! S_ISREG(st.st_mode) ||
+        st.st_size == 0)
+      return false;
+    const size_t size = st.st_size;
+    const size_t page = sysconf(_SC_PAGESIZE);
+    // reserve memory for the file and the extra byte after the last token,
+    // the file is mapped over the start.
+    const size_t mlen = (size + 1 + page - 1) / page * page;
+    void *m = mmap(NULL, mlen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m == MAP_FAILED)
+      return false;
+    if (mmap(m, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+      munmap(m, mlen);
+      return false;
+    }
+    madvise(m, size, MADV_SEQUENTIAL);
+    data = static_cast<char*>(m);
+    map_len = mlen;
+    pos = 0;
+    len = size;
+    eof = true;
+    return true;
+  }
+
+  /**
+   * wait for data and append it to the buffer.
+   * @param timeout_ms maximum time to wait, -1 waits forever.
+   * @return true if data was read or end of input was reached.
+   * @return false if the timeout expired or a signal was received.
+   */
+  bool fill(const int timeout_ms)
+  {
+    if (eof)
+      return true;
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, timeout_ms) <= 0)
+      return false;
+    return append();
+  }
+
+  /**
+   * read available data from fd and append it to the buffer.
+   * @return true if data was read or end of input was reached.
+   */
+  bool append()
+  {
+    // move unparsed data to the front of the buffer
+    if (pos > 0)
+    {
+      memmove(buf.data(), buf.data() + pos, len - pos);
+      len -= pos;
+      pos = 0;
+    }
+    if (len == buf.size() - 1)
+    {
+      // the buffer is full with a single token or line, drop it
+      len = 0;
+      skip_line = true;
+      ++metrics.invalid;
+    }
+    const ssize_t r = read(fd, buf.data() + len, buf.size() - 1 - len);
+    if (r < 0)
+    {
+      if (errno == EINTR ||
+          errno == EAGAIN)
+        return false;
+      eof = true;
+    }
+    else if (r == 0)
+    {
+      eof = true;
+    }
+    else
+    {
+      len += r;
+    }
+    return true;
+  }
+
+  /// receive a datagram from the socket fd, which replaces the buffer.
+  /// @return true if a datagram was received.
+  bool receive()
+  {
+    pos = 0;
+    const ssize_t r = recv(fd, data, buf.size() - 1, 0);
+    len = (r > 0) ? r : 0;
+    return r > 0;
+  }
+
+  /// start reading from the beginning of a new input.
+  void reset()
+  {
+    pos = 0;
+    len = 0;
+    eof = false;
+    skip_line = false;
+  }
+
+  static bool is_space(const char c)
+  {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+  }
+
+  /// discard input up to and including the next newline character.
+  /// @return false if more data is needed.
+  bool skip()
+  {
+    while(pos < len)
+    {
+      if (data[pos++] == '\n')
+      {
+        skip_line = false;
+        return true;
+      }
+    }
+    return eof;
+  }
+
+  /**
+   * find the next whitespace delimited token starting at @p p.
+   * A token is only complete if it is followed by whitespace or at end of input.
+   * @param[in,out] p position to start searching, set to the end of the token.
+   * @param[out] b beginning of the token.
+   * @return true if a complete token was found.
+   */
+  bool token(size_t &p, size_t &b) const
+  {
+    while(p < len && is_space(data[p]))
+      ++p;
+    b = p;
+    while(p < len && ! is_space(data[p]))
+      ++p;
+    if (b == p)
+      return false;
+    return p < len || eof;
+  }
+
+  /**
+   * parse a double value starting at data[b].
+   * Like scanf() only the longest valid prefix is used, the remaining characters
+   * of the token are left in the buffer.
+   * @param[in,out] p end of the token, set to the end of the value.
+   * @return true if a value was parsed.
+   */
+  bool value(const size_t b, size_t &p, double &v)
+  {
+    // there is always room for one additional byte after the token.
+    char *end;
+    if (! parse_double(data + b, data + p, v, end))
+      return false;
+    p = end - data;
+    return true;
+  }
+
+  /// parse @p n whitespace separated values.
+  result_t values(double *v, const unsigned n)
+  {
+    if (skip_line && ! skip())
+      return eof ? END : MORE;
+    size_t p = pos;
+    for(unsigned i = 0; i < n; ++i)
+    {
+      size_t b;
+      if (! token(p, b))
+      {
+        if (eof)
+          return END;
+        return MORE;
+      }
+      if (! value(b, p, v[i]))
+      {
+        pos = b;
+        skip_line = true;
+        ++metrics.invalid;
+        return INVALID;
+      }
+    }
+    pos = p;
+    return PARSED;
+  }
+
+  /**
+   * parse one line of key/value pairs.
+   * @param f function called with (key, key length, value) for each key/value pair.
+   *          The key points into the input buffer and is not terminated.
+   *          Parsing stops at the first key without a valid value.
+   * @param ts if not NULL the line starts with a timestamp which is stored in *ts.
+   * @return PARSED if at least one pair was parsed, INVALID if the line was empty or invalid.
+   */
+  template<typename F>
+  result_t key_values(F f, double *ts = NULL)
+  {
+    size_t eol = pos;
+    while(eol < len && data[eol] != '\n')
+      ++eol;
+    if (eol == len && ! eof)
+      return MORE;
+    if (eol == pos && eof)
+      return END;
+    size_t p = pos;
+    pos = (eol < len) ? eol + 1 : eol;
+    if (ts)
+    {
+      size_t tb;
+      if (! token(p, tb) || tb >= eol)
+        return INVALID;
+      if (! value(tb, p, *ts))
+      {
+        ++metrics.invalid;
+        return INVALID;
+      }
+    }
+    unsigned pairs = 0;
+    while(p < eol)
+    {
+      size_t kb;
+      if (! token(p, kb) || kb >= eol)
+        break;
+      const size_t klen = p - kb;
+      size_t vb;
+      double v;
+      if (! token(p, vb) || vb >= eol ||
+          ! value(vb, p, v))
+      {
+        // a key without a valid value
+        ++metrics.invalid;
+        break;
+      }
+      f(data + kb, klen, v);
+      ++pairs;
+    }
+    return pairs ? PARSED : INVALID;
+  }
+
+  /**
+   * parse the lines "key:value|type" of the statsd protocol in the buffer.
+   * The type and other fields after the value are ignored.
+   * @param f function called with (key, key length, value) for each line.
+   * @return PARSED if at least one line was parsed, MORE if the buffer was empty.
+   */
+  template<typename F>
+  result_t statsd(F f)
+  {
+    if (pos == len)
+      return MORE;
+    unsigned pairs = 0;
+    while(pos < len)
+    {
+      size_t eol = pos;
+      while(eol < len && data[eol] != '\n')
+        ++eol;
+      size_t colon = pos;
+      while(colon < eol && data[colon] != ':')
+        ++colon;
+      size_t e = colon;
+      while(e < eol && data[e] != '|' && data[e] != '\r')
+        ++e;
+      double v;
+      size_t p = e;
+      if (colon > pos && colon < eol &&
+          value(colon + 1, p, v))
+      {
+        f(data + pos, colon - pos, v);
+        ++pairs;
+      }
+      else if (eol > pos)
+      {
+        ++metrics.invalid;
+      }
+      pos = (eol < len) ? eol + 1 : eol;
+    }
+    return pairs ? PARSED : INVALID;
+  }
+
+  /// @return the little endian 16 bit number at @p p.
+  static uint16_t le16(const char *p)
+  {
+    const unsigned char *u = reinterpret_cast<const unsigned char*>(p);
+    return u[0] | (u[1] << 8);
+  }
+
+  /// @return the little endian float64 at @p p.
+  static double le_double(const char *p)
+  {
+    double v;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    char b[sizeof(v)];
+    for(size_t i = 0; i < sizeof(v); ++i)
+      b[i] = p[sizeof(v) - 1 - i];
+    memcpy(&v, b, sizeof(v));
+#else
+    memcpy(&v, p, sizeof(v));
+#endif
+    return v;
+  }
+
+  /**
+   * read @p n values of the --binary format, which are little endian float64 numbers.
+   * @return PARSED if all values were read.
+   */
+  result_t binary_values(double *v, const unsigned n)
+  {
+    const size_t size = n * sizeof(double);
+    if (len - pos < size)
+    {
+      if (! eof)
+        return MORE;
+      if (len > pos)
+        ++metrics.invalid;
+      return END;
+    }
+    for(unsigned i = 0; i < n; ++i)
+    {
+      v[i] = le_double(data + pos + i * sizeof(double));
+    }
+    pos += size;
+    return PARSED;
+  }
+
+  /**
+   * parse frames of the binary key/value format up to and including the next sample frame.
+   * A key frame is the character 'k', the 16 bit id of the key, the 8 bit length of the key and the key.
+   * A sample frame is the character 's', with @p ts a float64 timestamp,
+   * the 16 bit number of records and the records of a 16 bit key id and a float64 value.
+   * @param k function called with (id, key, key length) for a key frame.
+   * @param f function called with (id, value) for each record of a sample frame.
+   * @param ts if not NULL sample frames contain a timestamp which is stored in *ts.
+   * @return PARSED if a sample frame was parsed, INVALID if the frame type is unknown,
+   *         the byte is skipped then.
+   */
+  template<typename K, typename F>
+  result_t binary_key_values(K k, F f, double *ts = NULL)
+  {
+    while(1)
+    {
+      const size_t avail = len - pos;
+      if (avail == 0)
+        return eof ? END : MORE;
+      const char *p = data + pos;
+      size_t size = 0;
+      if (*p == 'k')
+      {
+        if (avail >= 4)
+        {
+          size = 4 + static_cast<unsigned char>(p[3]);
+        }
+      }
+      else if (*p == 's')
+      {
+        const size_t head = ts ? 11 : 3;
+        if (avail >= head)
+        {
+          const size_t n = le16(p + head - 2);
+          if (n > BINARY_RECORDS)
+          {
+            ++pos;
+            ++metrics.invalid;
+            return INVALID;
+          }
+          size = head + n * (2 + sizeof(double));
+        }
+      }
+      else
+      {
+        ++pos;
+        ++metrics.invalid;
+        return INVALID;
+      }
+      if (size == 0 ||
+          avail < size)
+      {
+        if (! eof)
+          return MORE;
+        ++metrics.invalid;
+        pos = len;
+        return END;
+      }
+      pos += size;
+      if (*p == 'k')
+      {
+        k(le16(p + 1), p + 4, size - 4);
+        continue;
+      }
+      ++p;
+      if (ts)
+      {
+        *ts = le_double(p);
+        p += sizeof(double);
+      }
+      const size_t n = le16(p);
+      p += 2;
+      for(size_t i = 0; i < n; ++i, p += 2 + sizeof(double))
+      {
+        f(le16(p), le_double(p + 2));
+      }
+      return n ? PARSED : INVALID;
+    }
+  }
+};
+
+/// @return number of bytes which can be read from @p fd without waiting.
+size_t
+readable(const int fd)
+{
+  int n = 0;
+  if (ioctl(fd, FIONREAD, &n) < 0)
+  {
+    n = 0;
+  }
+  return n;
+}
+
+/// lock-free queue with a power of two capacity for one producer and one consumer thread.
+/// Pushed elements are visible to the consumer after flush(). The producer calls
+/// flush_batch() after a group of elements, so the consumer only sees complete groups
+/// unless a group does not fit into the queue.
+/// The consumer waits with poll(), so it can wait for other file descriptors, too.
+template<typename T>
+class queue_t
+{
+  std::vector<T> buf;
+  const size_t mask;
+  // index of the next element to pop, only written by the consumer
+  std::atomic<size_t> head;
+  // index after the last flushed element, only written by the producer
+  std::atomic<size_t> tail;
+  // true while the consumer waits in wait()
+  std::atomic<bool> sleeping;
+  // pipe which wakes up the consumer
+  int wake[2];
+  // producer: index of the next element to push and the last known head
+  size_t next = 0;
+  size_t head_cache = 0;
+  // consumer: the last known tail
+  size_t tail_cache = 0;
+
+public:
+  /// @param capacity must be a power of two.
+  explicit queue_t(const size_t capacity) :
+    buf(capacity),
+    mask(capacity - 1),
+    head(0),
+    tail(0),
+    sleeping(false)
+  {
+    assert((capacity & mask) == 0);
+    if (pipe(wake) != 0)
+    {
+      perror("pipe");
+      exit(EXIT_FAILURE);
+    }
+    fcntl(wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake[1], F_SETFL, O_NONBLOCK);
+  }
+  ~queue_t()
+  {
+    close(wake[0]);
+    close(wake[1]);
+  }
+  queue_t(const queue_t&) = delete;
+  queue_t& operator=(const queue_t&) = delete;
+
+  /// @return number of elements in the queue.
+  size_t size() const { return tail.load() - head.load(); }
+  bool empty() const { return size() == 0; }
+
+  /// @return number of elements which can be pushed, called by the producer.
+  size_t space()
+  {
+    head_cache = head.load(std::memory_order_acquire);
+    return buf.size() - (next - head_cache);
+  }
+
+  /// add @p v, called by the producer.
+  /// @return false if the queue is full, the pushed elements are flushed then.
+  bool push(const T &v)
+  {
+    if (next - head_cache == buf.size())
+    {
+      head_cache = head.load(std::memory_order_acquire);
+      if (next - head_cache == buf.size())
+      {
+        flush();
+        return false;
+      }
+    }
+    buf[next++ & mask] = v;
+    return true;
+  }
+
+  /// flush if at least QUEUE_BATCH elements were pushed since the last flush,
+  /// called by the producer after the last element of a group.
+  void flush_batch()
+  {
+    if (next - tail.load(std::memory_order_relaxed) >= QUEUE_BATCH)
+    {
+      flush();
+    }
+  }
+
+  /// make the pushed elements visible to the consumer, called by the producer.
+  void flush()
+  {
+    if (tail.load(std::memory_order_relaxed) == next)
+      return;
+    // the store and the load of sleeping must not be reordered, see wait()
+    tail.store(next);
+    if (sleeping.load() &&
+        sleeping.exchange(false))
+    {
+      const char c = 0;
+      if (write(wake[1], &c, 1) < 0)
+      {
+        // the pipe is full, so the consumer will wake up
+      }
+    }
+  }
+
+  /// @return pointer to the first element or nullptr if the queue is empty, called by the consumer.
+  const T* peek()
+  {
+    const size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail_cache)
+    {
+      tail_cache = tail.load(std::memory_order_acquire);
+      if (h == tail_cache)
+        return nullptr;
+    }
+    return &buf[h & mask];
+  }
+
+  /// remove the first element into @p v, called by the consumer.
+  /// @return false if the queue is empty.
+  bool pop(T &v)
+  {
+    const T *p = peek();
+    if (! p)
+      return false;
+    v = *p;
+    head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * wait until the queue is not empty, @p fd is readable or @p timeout_ms expired.
+   * Called by the consumer.
+   * @param fd additional file descriptor, ignored if negative.
+   * @return the poll() revents of @p fd.
+   */
+  short wait(const int timeout_ms, const int fd)
+  {
+    sleeping.store(true);
+    if (! empty())
+    {
+      sleeping.store(false);
+      return 0;
+    }
+    struct pollfd pfd[2];
+    pfd[0].fd = wake[0];
+    pfd[0].events = POLLIN;
+    pfd[0].revents = 0;
+    pfd[1].fd = fd;
+    pfd[1].events = POLLIN;
+    pfd[1].revents = 0;
+    if (poll(pfd, 2, timeout_ms) <= 0)
+    {
+      pfd[1].revents = 0;
+    }
+    sleeping.store(false);
+    if (pfd[0].revents)
+    {
+      char b[64];
+      while(read(wake[0], b, sizeof(b)) > 0)
+        ;
+    }
+    return pfd[1].revents;
+  }
+};
+
+/// record passed from the reader thread to the main thread.
+struct record_t
+{
+  enum kind_t : uint8_t {
+    SAMPLE,  ///< a sample or line of key/value pairs starts, value is the time of the sample in seconds
+    VALUE,   ///< value of graph id
+    KEY,     ///< graph id has the key *key, the main thread deletes key
+    END      ///< end of input
+  } kind;
+  uint32_t id;
+  double value;
+  // time the input was read in microseconds of getus()
+  size_t us;
+  std::string *key;
+};
+
+/// graph type of the table used by the reader thread to find the graph ids.
+struct key_entry_t
+{
+  std::string key;
+  void init(std::string) {}
+};
+
+/**
+ * @return the first slot of the last sample which was committed before slot @p seq of @p shm,
+ *         or seq if the producer already writes into that sample.
+ */
+uint64_t
+shm_last_sample(const ttyplot_shm *shm, const uint64_t seq)
+{
+  for(uint64_t i = seq; i > 0 && seq - i < TTYPLOT_SHM_SLOTS; )
+  {
+    --i;
+    const uint32_t first = shm->slot[i & (TTYPLOT_SHM_SLOTS - 1)].first;
+    // the slot was read before the producer wrote it again
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&shm->head, __ATOMIC_RELAXED) - i > TTYPLOT_SHM_SLOTS)
+      break;
+    if (first)
+      return i;
+  }
+  return seq;
+}
+
+/// an input of the reader thread.
+struct source_t
+{
+  enum kind_t {
+    STREAM,    ///< stdin, the --replay file or a connection to the --unix socket
+    FIFO,      ///< a --fifo, which is opened again when the writer closes it
+    DATAGRAM,  ///< the --udp socket, each datagram has statsd lines of one sample
+    LISTEN,    ///< the --unix socket, connections are added as STREAM
+    SHM        ///< a --shm ring, which has no file descriptor and is checked every SHM_POLL_MS
+  } kind = STREAM;
+  // path of a FIFO
+  const char *path = NULL;
+  input_t input;
+  // graph ids of the key ids defined by key frames of the binary format or in a --shm ring
+  std::vector<uint32_t> binary_ids;
+  // the --shm ring, the next slot which is read and the number of keys which have a graph id
+  const ttyplot_shm *shm = NULL;
+  uint64_t shm_next = 0;
+  uint32_t shm_keys = 0;
+
+  /// @return the graph id of the key id @p bid, values_table_t::npos if the key was not defined.
+  size_t binary_id(const uint32_t bid) const
+  {
+    if (bid >= binary_ids.size() ||
+        binary_ids[bid] == UINT32_MAX)
+      return values_table_t::npos;
+    return binary_ids[bid];
+  }
+
+  /**
+   * parse frames of the binary key/value format of input up to and including the next sample frame.
+   * @param k function called with (key, key length) for a key frame, which returns the graph id of the key.
+   * @param f function called with (graph id, value) for each record with a defined key id.
+   * @param ts if not NULL sample frames contain a timestamp which is stored in *ts.
+   * @return the result of input_t::binary_key_values().
+   */
+  template<typename K, typename F>
+  input_t::result_t binary_key_values(K k, F f, double *ts)
+  {
+    return input.binary_key_values([&](const uint16_t bid, const char *key, const size_t klen) {
+        if (klen == 0)
+        {
+          // a graph needs a key
+          ++metrics.invalid;
+          return;
+        }
+        if (bid >= binary_ids.size())
+        {
+          binary_ids.resize(bid + 1, UINT32_MAX);
+        }
+        binary_ids[bid] = k(key, klen);
+      }, [&](const uint16_t bid, const double v) {
+        const size_t id = binary_id(bid);
+        if (id == values_table_t::npos)
+        {
+          // a value for an undefined key
+          ++metrics.invalid;
+          return;
+        }
+        f(id, v);
+      }, ts);
+  }
+
+  /**
+   * read the next sample of the --shm ring.
+   * @param k function called with (key, key length) for each new key of the ring, which returns the graph id of the key.
+   * @param f function called with (key id, value, timestamp or NULL) for each value of the sample,
+   *          which returns false if the value is invalid.
+   * @param drop function called if the ring was overwritten before it was read,
+   *             the values passed to f since the last sample are dropped then.
+   * @return PARSED if values of a sample were passed to f, MORE if all committed samples were read.
+   */
+  template<typename K, typename F, typename D>
+  input_t::result_t shm_values(K k, F f, D drop)
+  {
+    uint64_t seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+    if (seq < shm_next)
+    {
+      // the producer created a new ring
+      shm_next = seq;
+      shm_keys = 0;
+      binary_ids.clear();
+    }
+    // graph ids of the keys which were added since the last sample
+    const uint32_t nkeys = std::min<uint32_t>(__atomic_load_n(&shm->nkeys, __ATOMIC_ACQUIRE), TTYPLOT_SHM_KEYS);
+    for(; shm_keys < nkeys; ++shm_keys)
+    {
+      const char *key = shm->key[shm_keys];
+      const size_t klen = strnlen(key, TTYPLOT_SHM_KEY_SIZE - 1);
+      // a graph needs a key, the values of an empty key are invalid
+      binary_ids.push_back(klen ? k(key, klen) : UINT32_MAX);
+    }
+    // the values of a sample end at the first slot of the next sample
+    double ts = 0;
+    bool has_ts = false;
+    bool parsed = false;
+    while(shm_next < seq)
+    {
+      const ttyplot_shm_slot slot = shm->slot[shm_next & (TTYPLOT_SHM_SLOTS - 1)];
+      // the slot was copied before the producer wrote it again
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&shm->head, __ATOMIC_RELAXED) - shm_next > TTYPLOT_SHM_SLOTS)
+      {
+        // ttyplot fell behind by more than the ring, continue with the latest sample
+        seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+        shm_next = shm_last_sample(shm, seq);
+        has_ts = false;
+        parsed = false;
+        drop();
+        ++metrics.dropped;
+        continue;
+      }
+      if (slot.first &&
+          parsed)
+        return input_t::PARSED;
+      ++shm_next;
+      if (slot.key == TTYPLOT_SHM_TIME)
+      {
+        ts = slot.value;
+        has_ts = true;
+        continue;
+      }
+      if (! f(slot.key, slot.value, has_ts ? &ts : NULL))
+      {
+        // a value for an undefined key
+        ++metrics.invalid;
+        continue;
+      }
+      parsed = true;
+    }
+    return parsed ? input_t::PARSED : input_t::MORE;
+  }
+};
+
+/// open the FIFO @p path for reading without waiting for a writer.
+/// @return the file descriptor, -1 on error.
+int
+open_fifo(const char *path)
+{
+  return open(path, O_RDONLY | O_NONBLOCK);
+}
+
+/**
+ * open a UDP socket for the statsd protocol.
+ * @param addr "port" or "address:port" of an IPv4 address, the default address is 127.0.0.1.
+ * @return the socket, -1 on error.
+ */
+int
+open_udp(const char *addr)
+{
+  struct sockaddr_in sin;
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  const char *port = strrchr(addr, ':');
+  if (port)
+  {
+    const std::string host(addr, port - addr);
+    if (inet_pton(AF_INET, host.c_str(), &sin.sin_addr) != 1)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+    ++port;
+  }
+  else
+  {
+    port = addr;
+  }
+  const int p = atoi(port);
+  if (p <= 0 || p > 65535)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+  sin.sin_port = htons(p);
+  const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0)
+    return -1;
+  if (bind(fd, reinterpret_cast<struct sockaddr*>(&sin), sizeof(sin)) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * create a listening Unix domain stream socket.
+ * A stale socket file at @p path is removed.
+ * @return the socket, -1 on error.
+ */
+int
+open_unix(const char *path)
+{
+  struct sockaddr_un sun;
+  memset(&sun, 0, sizeof(sun));
+  sun.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(sun.sun_path))
+  {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(sun.sun_path, path);
+  struct stat st;
+  if (stat(path, &st) == 0 &&
+      S_ISSOCK(st.st_mode))
+  {
+    unlink(path);
+  }
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  if (bind(fd, reinterpret_cast<struct sockaddr*>(&sun), sizeof(sun)) != 0 ||
+      listen(fd, 16) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * map the --shm ring @p name of a producer, which is created by ttyplot_shm_create(), read only.
+ * @return the ring, NULL on error with errno set.
+ */
+const ttyplot_shm*
+open_shm(const char *name)
+{
+  const int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      st.st_size < static_cast<off_t>(sizeof(ttyplot_shm)))
+  {
+    close(fd);
+    errno = EINVAL;
+    return NULL;
+  }
+  void *p = mmap(NULL, sizeof(ttyplot_shm), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+    return NULL;
+  const ttyplot_shm *shm = static_cast<const ttyplot_shm*>(p);
+  if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != TTYPLOT_SHM_MAGIC ||
+      shm->version != TTYPLOT_SHM_VERSION ||
+      shm->slots != TTYPLOT_SHM_SLOTS ||
+      shm->keys != TTYPLOT_SHM_KEYS)
+  {
+    munmap(p, sizeof(ttyplot_shm));
+    errno = EINVAL;
+    return NULL;
+  }
+  return shm;
+}
+
+// bench.cpp includes this file without main()
+#ifndef TTYPLOT_NO_MAIN
+int
+main(int argc, char *argv[])
+{
+  const std::string one_str = "1";
+  const std::string two_str = "2";
+  // number of values shown of each graph and rows of the plot
+  int plotwidth=0, plotheight=0;
+  int c;
   int parsed_colors = -1;
   char max_errchar='e', min_errchar='v';
   double softmax=DOUBLE_MIN;
@@ -609,14 +4655,76 @@ main(int argc, char *argv[])
   std::string color_str;
   bool rate = false;
   bool bars = false;
+  // true if every sample or line starts with a timestamp in seconds
+  bool timestamps = false;
+  // true if the input is in the binary format
+  bool binary = false;
+  // true if the scale follows the visible values instead of only growing
+  bool autoscale = false;
+  // with --top only the top graphs are plotted, the others still collect their values
+  size_t top = 0;
+  values_t::rank_t top_by = values_t::RANK_MAX;
+  // with --headless the statistics are written to stdout instead of plotted
+  Headless headless = Headless::NONE;
+  // true if the graphs are drawn with braille dots
+  bool braille = false;
+  // true if the frames are written as VT100 escape sequences instead of with curses
+  bool ansi_output = false;
+  // with -F the amplitude spectrum of the graphs is plotted, with --waterfall the history of
+  // the spectrum of the first graph. The spectrum is calculated every fft_every values.
+  bool spectrum = false;
+  bool waterfall = false;
+  size_t fft_every = 0;
+  // additional inputs
+  std::vector<const char*> fifos;
+  const char *udp = NULL;
+  const char *unix_path = NULL;
+  const char *shm_name = NULL;
+  // file read with --replay instead of stdin
+  const char *replay = NULL;
+  // replay speed relative to the timestamps, 0 replays as fast as possible
+  double speed = 0;
+  // file of --state which keeps the graphs when ttyplot is restarted
+  const char *state_fn = NULL;
+  int fps = 0;
 
   enum class OperatingMode {
     ONE, TWO, KV
   } op_mode = OperatingMode::ONE;
 
+  // what the reader thread does if the queue to the main thread is full
+  enum class Overflow {
+    BLOCK, DROP, COALESCE
+  } overflow = Overflow::BLOCK;
+
   values[one_str].name = '#';
 
-  while((c=getopt(argc, argv, "2bkrc:C:e:E:s:S:m:M:t:u:")) != -1)
+  static const struct option long_options[] = {
+    {"fps", required_argument, NULL, 'G'},
+    {"bucket", required_argument, NULL, 'B'},
+    {"stats", no_argument, NULL, 'T'},
+    {"overflow", required_argument, NULL, 'O'},
+    {"timestamps", no_argument, NULL, 'P'},
+    {"replay", required_argument, NULL, 'R'},
+    {"binary", no_argument, NULL, 'Y'},
+    {"fifo", required_argument, NULL, 'I'},
+    {"udp", required_argument, NULL, 'U'},
+    {"unix", required_argument, NULL, 'L'},
+    {"quantiles", required_argument, NULL, 'Q'},
+    {"autoscale", no_argument, NULL, 'A'},
+    {"top", required_argument, NULL, 'N'},
+    {"top-by", required_argument, NULL, 'K'},
+    {"speed", required_argument, NULL, 'X'},
+    {"headless", required_argument, NULL, 'H'},
+    {"braille", no_argument, NULL, 'D'},
+    {"ansi", no_argument, NULL, 'V'},
+    {"waterfall", no_argument, NULL, 'W'},
+    {"fft-every", required_argument, NULL, 'J'},
+    {"shm", required_argument, NULL, 'Z'},
+    {"state", required_argument, NULL, 'f'},
+    {NULL, 0, NULL, 0}
+  };
+  while((c=getopt_long(argc, argv, "2bkrFc:C:e:E:s:S:m:M:t:u:", long_options, NULL)) != -1)
     switch(c) {
       case 'b':
         bars = true;
@@ -633,237 +4741,1251 @@ main(int argc, char *argv[])
         op_mode = OperatingMode::KV;
         values.clear();
         break;
-      case 'C':
-        color_str = optarg;
+      case 'C':
+        color_str = optarg;
+        break;
+      case 'c':
+        if (op_mode == OperatingMode::ONE)
+        {
+          values[one_str].name = optarg[0];
+        }
+        else if (op_mode == OperatingMode::TWO)
+        {
+          values[one_str].name = optarg[0];
+          values[two_str].name = optarg[1];
+        }
+        else
+        {
+          printf("command line argument -c ignored in key/value mode\n");
+        }
+        break;
+      case 'e':
+        max_errchar=optarg[0];
+        break;
+      case 'E':
+        min_errchar=optarg[0];
+        break;
+      case 's':
+        softmax=atof(optarg);
+        break;
+      case 'S':
+        softmin=atof(optarg);
+        break;
+      case 'm':
+        hardmax=atof(optarg);
+        break;
+      case 'M':
+        hardmin=atof(optarg);
+        break;
+      case 't':
+        title = optarg;
+        break;
+      case 'u':
+        unit = optarg;
+        break;
+      case 'B':
+        if (atoi(optarg) <= 0)
+        {
+          printf("--bucket must be a positive number\n");
+          usage();
+        }
+        values_t::bucket_ms = atoi(optarg);
+        break;
+      case 'T':
+        print_stats = true;
+        break;
+      case 'P':
+        timestamps = true;
+        break;
+      case 'R':
+        replay = optarg;
+        break;
+      case 'Y':
+        binary = true;
+        break;
+      case 'I':
+        fifos.push_back(optarg);
+        break;
+      case 'U':
+        udp = optarg;
+        break;
+      case 'L':
+        unix_path = optarg;
+        break;
+      case 'Z':
+        shm_name = optarg;
+        break;
+      case 'f':
+        state_fn = optarg;
+        break;
+      case 'A':
+        autoscale = true;
+        break;
+      case 'D':
+        braille = true;
+        break;
+      case 'V':
+        ansi_output = true;
+        break;
+      case 'F':
+        spectrum = true;
+        break;
+      case 'W':
+        spectrum = true;
+        waterfall = true;
         break;
-      case 'c':
-        if (op_mode == OperatingMode::ONE)
+      case 'J':
+        if (atoi(optarg) <= 0)
         {
-          values[one_str].name = optarg[0];
+          printf("--fft-every must be a positive number\n");
+          usage();
         }
-        else if (op_mode == OperatingMode::TWO)
+        fft_every = atoi(optarg);
+        break;
+      case 'N':
+        if (atoi(optarg) <= 0)
         {
-          values[one_str].name = optarg[0];
-          values[two_str].name = optarg[1];
+          printf("--top must be a positive number\n");
+          usage();
+        }
+        top = atoi(optarg);
+        break;
+      case 'K':
+        if (strcmp(optarg, "last") == 0)
+        {
+          top_by = values_t::RANK_LAST;
+        }
+        else if (strcmp(optarg, "avg") == 0)
+        {
+          top_by = values_t::RANK_AVG;
+        }
+        else if (strcmp(optarg, "max") == 0)
+        {
+          top_by = values_t::RANK_MAX;
         }
         else
         {
-          printf("command line argument -c ignored in key/value mode\n");
+          printf("--top-by must be last, avg or max\n");
+          usage();
         }
         break;
-      case 'e':
-        max_errchar=optarg[0];
-        break;
-      case 'E':
-        min_errchar=optarg[0];
-        break;
-      case 's':
-        softmax=atof(optarg);
-        break;
-      case 'S':
-        softmin=atof(optarg);
+      case 'Q':
+        {
+          values_t::quantiles.clear();
+          char *p = optarg;
+          while(1)
+          {
+            char *end;
+            const double q = strtod(p, &end);
+            if (end == p || q < 0 || q > 100 ||
+                (*end != ',' && *end != 0))
+            {
+              printf("--quantiles must be a list of percentiles like 50,95,99\n");
+              usage();
+            }
+            values_t::quantiles.push_back(q / 100);
+            if (*end == 0)
+              break;
+            p = end + 1;
+          }
+        }
         break;
-      case 'm':
-        hardmax=atof(optarg);
+      case 'X':
+        if (strcmp(optarg, "max") == 0)
+        {
+          speed = 0;
+        }
+        else
+        {
+          // "10x" and "10" are the same speed
+          speed = atof(optarg);
+          if (speed <= 0)
+          {
+            printf("--speed must be a positive number followed by x, or max\n");
+            usage();
+          }
+        }
         break;
-      case 'M':
-        hardmin=atof(optarg);
+      case 'O':
+        if (strcmp(optarg, "block") == 0)
+        {
+          overflow = Overflow::BLOCK;
+        }
+        else if (strcmp(optarg, "drop") == 0)
+        {
+          overflow = Overflow::DROP;
+        }
+        else if (strcmp(optarg, "coalesce") == 0)
+        {
+          overflow = Overflow::COALESCE;
+        }
+        else
+        {
+          printf("--overflow must be drop, coalesce or block\n");
+          usage();
+        }
         break;
-      case 't':
-        title = optarg;
+      case 'H':
+        if (strcmp(optarg, "csv") == 0)
+        {
+          headless = Headless::CSV;
+        }
+        else if (strcmp(optarg, "json") == 0)
+        {
+          headless = Headless::JSON;
+        }
+        else
+        {
+          printf("--headless must be csv or json\n");
+          usage();
+        }
         break;
-      case 'u':
-        unit = optarg;
+      case 'G':
+        fps = atoi(optarg);
+        if (fps <= 0)
+        {
+          printf("--fps must be a positive number\n");
+          usage();
+        }
         break;
       case '?':
         usage();
         break;
     }
 
+  // ids of the graphs in one and two value mode
+  size_t one_id = values_table_t::npos, two_id = values_table_t::npos;
+  if (op_mode != OperatingMode::KV)
+  {
+    one_id = values.id(one_str.data(), one_str.size());
+  }
+  if (op_mode == OperatingMode::TWO)
+  {
+    two_id = values.id(two_str.data(), two_str.size());
+  }
+
   // unlink(debug_fn);
   if (softmax <= hardmin)
     softmax = hardmin + 1;
   if (hardmax <= hardmin)
     hardmax = DOUBLE_MAX;
 
+  if (udp &&
+      op_mode != OperatingMode::KV)
+  {
+    printf("--udp requires key/value mode -k\n");
+    usage();
+  }
+  if (spectrum &&
+      braille)
+  {
+    printf("-F can not be combined with --braille\n");
+    usage();
+  }
+
+  // with --state the graphs of the previous run are restored before the reader thread knows their keys
+  state_t restored;
+  restored.options = static_cast<uint32_t>(op_mode) | rate << 2 | spectrum << 3 | waterfall << 4;
+  if (state_fn &&
+      ! load_state(state_fn, restored) &&
+      errno != ENOENT)
+  {
+    if (errno)
+    {
+      perror(state_fn);
+      exit(EXIT_FAILURE);
+    }
+    printf("%s was written with other options or is damaged, it is replaced\n", state_fn);
+  }
+  if (values_t::bucket_ms > 0 &&
+      restored.gen > 0)
+  {
+    // the buckets while ttyplot was not running are missing
+    const double now = gettime();
+    if (now > restored.time)
+    {
+      restored.gen += static_cast<size_t>((now - restored.time) * 1000 / values_t::bucket_ms);
+    }
+  }
+
+  // stdin is used for data, keys are read from the terminal if it can be opened
+  FILE *tty = (headless == Headless::NONE) ? fopen("/dev/tty", "r") : NULL;
+  // inputs of the reader thread
+  std::list<source_t> sources;
+  if (replay)
+  {
+    sources.emplace_back();
+    sources.back().input.fd = open(replay, O_RDONLY);
+    if (sources.back().input.fd < 0)
+    {
+      perror(replay);
+      exit(EXIT_FAILURE);
+    }
+    sources.back().input.map(sources.back().input.fd);
+  }
+  else if ((fifos.empty() && ! udp && ! unix_path && ! shm_name) ||
+           ! isatty(STDIN_FILENO))
+  {
+    // stdin is not read from a terminal if there are other inputs
+    sources.emplace_back();
+  }
+  for(const auto path : fifos)
+  {
+    sources.emplace_back();
+    sources.back().kind = source_t::FIFO;
+    sources.back().path = path;
+    sources.back().input.fd = open_fifo(path);
+    if (sources.back().input.fd < 0)
+    {
+      perror(path);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (udp)
+  {
+    sources.emplace_back();
+    sources.back().kind = source_t::DATAGRAM;
+    sources.back().input.fd = open_udp(udp);
+    if (sources.back().input.fd < 0)
+    {
+      perror(udp);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (unix_path)
+  {
+    sources.emplace_back();
+    sources.back().kind = source_t::LISTEN;
+    sources.back().input.fd = open_unix(unix_path);
+    if (sources.back().input.fd < 0)
+    {
+      perror(unix_path);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (shm_name)
+  {
+    sources.emplace_back();
+    sources.back().kind = source_t::SHM;
+    sources.back().input.fd = -1;
+    sources.back().shm = open_shm(shm_name);
+    if (! sources.back().shm)
+    {
+      perror(shm_name);
+      exit(EXIT_FAILURE);
+    }
+    // samples which were committed before ttyplot started are not read
+    sources.back().shm_next = __atomic_load_n(&sources.back().shm->seq, __ATOMIC_ACQUIRE);
+  }
+
 #ifdef __OpenBSD__
-  if (pledge("stdio tty", NULL) == -1)
+  // FIFOs are opened again, connections are accepted on the --unix socket
+  std::string promises = "stdio tty";
+  if (! fifos.empty())
+    promises += " rpath";
+  if (unix_path)
+    promises += " unix";
+  if (pledge(promises.c_str(), NULL) == -1)
     err(1, "pledge");
 #endif
 
-  sp = newterm(NULL, stdout, stdin);
-  if (! color_str.empty())
+  int screenwidth=0, screenheight=0;
+  if (headless != Headless::NONE)
   {
-    start_color();
-    parsed_colors = parseColors(color_str);
+    // ncurses is not used, a summary is written once per second or --fps times per second
+    signal(SIGINT,  stop);
+    signal(SIGTERM, stop);
+    if (fps == 0)
+    {
+      fps = 1;
+    }
+    screenwidth = HEADLESS_WIDTH + 1;
+    headless_header(stdout, headless);
   }
+  else
+  {
+    if (braille)
+    {
+      // only the character encoding is used, numbers are printed in the C locale
+      setlocale(LC_CTYPE, "");
+      if (strcmp(nl_langinfo(CODESET), "UTF-8") != 0)
+      {
+        fprintf(stderr, "--braille requires a UTF-8 locale\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+    if (ansi_output)
+    {
+      // the VT100 sequences replace the terminal description of curses
+      parsed_colors = parseColors(color_str);
+      ansi.begin(tty ? fileno(tty) : -1);
+      ansi.size(screenwidth, screenheight);
+    }
+    else
+    {
+      sp = newterm(NULL, stdout, tty ? tty : stdin);
+      if (! color_str.empty())
+      {
+        start_color();
+        parsed_colors = parseColors(color_str);
+      }
 
-  noecho();
-  curs_set(FALSE);
-  signal(SIGWINCH, resize);
-  signal(SIGINT,  finish);
-  signal(SIGTERM, finish);
-  signal(SIGSEGV, finish);
-
-  erase();
-  int screenwidth=0, screenheight=0;
+      noecho();
+      if (tty)
+      {
+        cbreak();
+        nodelay(stdscr, TRUE);
+        keypad(stdscr, TRUE);
+      }
+      curs_set(FALSE);
 #ifdef NOGETMAXYX
-  screenheight=LINES;
-  screenwidth=COLS;
+      screenheight=LINES;
+      screenwidth=COLS;
 #else
-  getmaxyx(stdscr, screenheight, screenwidth);
+      getmaxyx(stdscr, screenheight, screenwidth);
 #endif
-  mvprintw(screenheight/2, (screenwidth/2)-14, "waiting for data from stdin");
-  refresh();
+    }
+    signal(SIGWINCH, resize);
+    // with --state the main loop writes the file before ttyplot exits
+    signal(SIGINT,  state_fn ? stop : finish);
+    signal(SIGTERM, state_fn ? stop : finish);
+    signal(SIGSEGV, finish);
+  }
+  // show fb on the terminal, if @p full is true all cells are written
+  auto present = [&](const bool full) {
+    if (ansi_output)
+    {
+      ansi.write(fb, full);
+      return;
+    }
+    fb.flush();
+    move(0,0);
+    refresh();
+  };
+  if (headless == Headless::NONE)
+  {
+    fb.resize(screenwidth, screenheight);
+    if (replay)
+    {
+      fb.print(screenheight/2, (screenwidth/2)-14, "reading %s", replay);
+    }
+    else if (! fifos.empty() || udp || unix_path || shm_name)
+    {
+      fb.text(screenheight/2, (screenwidth/2)-14, "waiting for data");
+    }
+    else
+    {
+      fb.text(screenheight/2, (screenwidth/2)-14, "waiting for data from stdin");
+    }
+    present(true);
+  }
 
-  auto t1 = getms();
-  double global_max = DOUBLE_MIN;
-  double global_min = DOUBLE_MAX;
+  const auto start_ms = getms();
+  metrics.start_ms = start_ms;
+  // in rate mode the time of the previous sample in seconds
+  double t1 = restored.t1;
+  double global_max = restored.global_max;
+  double global_min = restored.global_min;
+  double td = restored.td;
+  plotwidth = (screenwidth - 1) * (braille ? BRAILLE_X : spectrum ? SPECTRUM_X : 1);
+  // terminal with keyboard input, -1 if keys are not read
+  int tty_fd = tty ? fileno(tty) : -1;
+
+  // the reader thread parses the input and passes records to the main thread,
+  // so the input is read while the main thread waits for the terminal.
+  queue_t<record_t> queue(QUEUE_SIZE);
+  // ids of the graphs in key/value mode, the reader thread creates the same ids as values
+  table_t<key_entry_t> keys;
+  for(size_t id = 0; id < values.size(); ++id)
+  {
+    keys.id(values[id].key.data(), values[id].key.size());
+  }
+  auto read_input = [&]() {
+    // with --replay and without --timestamps the samples are one second apart
+    size_t replay_n = 0;
+    // wall clock time in microseconds and timestamp of the first replayed sample
+    size_t replay_us = 0;
+    double replay_ts = DOUBLE_UNINIT;
+    // records of the current sample
+    std::vector<record_t> group;
+    record_t rec;
+    rec.id = 0;
+    rec.value = 0;
+    rec.key = nullptr;
+    // time of the last read
+    rec.us = getus();
+    // add the record which starts a sample with the timestamp from the input or the read time
+    auto add_sample = [&](const double *ts) {
+      rec.kind = record_t::SAMPLE;
+      if (ts)
+      {
+        rec.value = *ts;
+      }
+      else
+      {
+        rec.value = replay ? replay_n++ : rec.us / 1e6;
+      }
+      group.push_back(rec);
+    };
+    auto add = [&](const record_t::kind_t kind) {
+      rec.kind = kind;
+      group.push_back(rec);
+    };
+    auto add_value = [&](const size_t id, const double v) {
+      rec.id = id;
+      rec.value = v;
+      add(record_t::VALUE);
+    };
+    auto push = [&](const record_t &r) {
+      while(! queue.push(r))
+      {
+        usleep(1000);
+      }
+    };
+    // with --overflow=coalesce the latest value of each graph id which did not fit into the queue,
+    // true in pending if latest has a value of the id, and the ids with a value.
+    // A flag marks the pending values, as -FLT_MAX and NaN are input values, too.
+    std::vector<double> latest;
+    std::vector<bool> pending;
+    std::vector<uint32_t> latest_ids;
+    record_t latest_sample;
+    // push the coalesced sample if there is space in the queue
+    auto push_latest = [&]() {
+      if (latest_ids.empty() ||
+          queue.space() < latest_ids.size() + 1)
+        return;
+      record_t r = latest_sample;
+      queue.push(r);
+      r.kind = record_t::VALUE;
+      for(const auto id : latest_ids)
+      {
+        r.id = id;
+        r.value = latest[id];
+        pending[id] = false;
+        queue.push(r);
+      }
+      latest_ids.clear();
+    };
+    // with --replay and --speed wait until the sample in group is due
+    auto pace = [&]() {
+      const double ts = group.front().value;
+      if (replay_ts == DOUBLE_UNINIT)
+      {
+        replay_ts = ts;
+        replay_us = getus();
+        return;
+      }
+      const size_t due = replay_us + std::max(0.0, (ts - replay_ts) / speed * 1e6);
+      size_t now = getus();
+      if (now >= due)
+        return;
+      // show the previous samples while waiting
+      queue.flush();
+      while(now < due)
+      {
+        usleep(std::min<size_t>(due - now, 100000));
+        now = getus();
+      }
+    };
+    // push the records of the sample in group according to the overflow policy
+    auto submit = [&]() {
+      if (replay &&
+          speed > 0)
+      {
+        pace();
+      }
+      push_latest();
+      if (overflow == Overflow::BLOCK)
+      {
+        for(const auto &r : group)
+          push(r);
+      }
+      else if (latest_ids.empty() &&
+               queue.space() >= group.size())
+      {
+        for(const auto &r : group)
+          queue.push(r);
+      }
+      else
+      {
+        for(const auto &r : group)
+        {
+          // keys are never dropped, the main thread creates the same graph ids
+          if (r.kind == record_t::KEY)
+          {
+            push(r);
+          }
+          else if (r.kind == record_t::VALUE &&
+                   overflow == Overflow::COALESCE)
+          {
+            if (r.id >= latest.size())
+            {
+              latest.resize(r.id + 1);
+              pending.resize(r.id + 1, false);
+            }
+            if (! pending[r.id])
+            {
+              pending[r.id] = true;
+              latest_ids.push_back(r.id);
+            }
+            latest[r.id] = r.value;
+          }
+          else if (r.kind == record_t::SAMPLE)
+          {
+            latest_sample = r;
+          }
+        }
+        if (overflow == Overflow::DROP)
+        {
+          ++metrics.dropped;
+        }
+        else
+        {
+          ++metrics.coalesced;
+        }
+      }
+      group.clear();
+      // the main thread draws a frame when the queue is empty, a sample is passed to it at once
+      queue.flush_batch();
+    };
+    // @return the graph id of a key, a new key is added to the sample
+    auto key_id = [&](const char *k, const size_t klen) {
+      size_t id = keys.find(k, klen);
+      if (id == values_table_t::npos)
+      {
+        id = keys.id(k, klen);
+        rec.id = id;
+        rec.key = new std::string(k, klen);
+        add(record_t::KEY);
+        rec.key = nullptr;
+      }
+      return id;
+    };
+    // @return the graph id of a key, a new key is passed to the main thread at once
+    auto push_key_id = [&](const char *k, const size_t klen) {
+      size_t id = keys.find(k, klen);
+      if (id == values_table_t::npos)
+      {
+        id = keys.id(k, klen);
+        push(record_t{record_t::KEY, static_cast<uint32_t>(id), 0, rec.us, new std::string(k, klen)});
+      }
+      return id;
+    };
+    // parse one sample of src
+    auto parse = [&](source_t &src) {
+      input_t::result_t r;
+      if (src.kind == source_t::DATAGRAM)
+      {
+        // a datagram of statsd lines is one sample
+        r = src.input.statsd([&](const char *k, const size_t klen, const double v) {
+            if (group.empty())
+            {
+              add_sample(NULL);
+            }
+            add_value(key_id(k, klen), v);
+          });
+        return r;
+      }
+      if (src.kind == source_t::LISTEN)
+      {
+        return input_t::MORE;
+      }
+      if (src.kind == source_t::SHM)
+      {
+        rec.us = getus();
+        return src.shm_values(push_key_id, [&](const uint32_t key, const double v, const double *ts) {
+            size_t id;
+            if (op_mode == OperatingMode::KV)
+            {
+              id = src.binary_id(key);
+            }
+            else
+            {
+              id = (key == 0) ? one_id : (key == 1 && op_mode == OperatingMode::TWO) ? two_id : values_table_t::npos;
+            }
+            if (id == values_table_t::npos)
+              return false;
+            if (group.empty())
+            {
+              add_sample(timestamps ? ts : NULL);
+            }
+            add_value(id, v);
+            return true;
+          }, [&]() {
+            group.clear();
+          });
+      }
+      // with --timestamps v[0] is the timestamp of the sample
+      const unsigned t = timestamps ? 1 : 0;
+      if (op_mode == OperatingMode::ONE)
+      {
+        double v[2];
+        r = binary ? src.input.binary_values(v, t + 1) : src.input.values(v, t + 1);
+        if (r == input_t::PARSED)
+        {
+          add_sample(timestamps ? &v[0] : NULL);
+          add_value(one_id, v[t]);
+        }
+      }
+      else if (op_mode == OperatingMode::TWO)
+      {
+        double v[3];
+        r = binary ? src.input.binary_values(v, t + 2) : src.input.values(v, t + 2);
+        if (r == input_t::PARSED)
+        {
+          add_sample(timestamps ? &v[0] : NULL);
+          add_value(one_id, v[t]);
+          add_value(two_id, v[t + 1]);
+        }
+      }
+      else if (op_mode == OperatingMode::KV &&
+               binary)
+      {
+        // key frames define the ids used by the producer, the values are not tokenized
+        double ts;
+        r = src.binary_key_values(push_key_id, [&](const size_t id, const double v) {
+            if (group.empty())
+            {
+              add_sample(timestamps ? &ts : NULL);
+            }
+            add_value(id, v);
+          }, timestamps ? &ts : NULL);
+        if (r == input_t::PARSED &&
+            group.empty())
+        {
+          r = input_t::INVALID;
+        }
+      }
+      else if (op_mode == OperatingMode::KV)
+      {
+        // parse a line for key/value pairs.
+        // graphs without a value in this line are padded when they are drawn.
+        double ts;
+        r = src.input.key_values([&](const char *k, const size_t klen, const double v) {
+            if (group.empty())
+            {
+              add_sample(timestamps ? &ts : NULL);
+            }
+            add_value(key_id(k, klen), v);
+          }, timestamps ? &ts : NULL);
+      }
+      else
+      {
+        assert(false);
+      }
+      return r;
+    };
+    std::vector<struct pollfd> pfds;
+    while(1)
+    {
+      // parse the buffered input of all sources
+      for(auto src = sources.begin(); src != sources.end(); )
+      {
+        input_t::result_t r;
+        do
+        {
+          r = parse(*src);
+          if (r == input_t::PARSED)
+          {
+            submit();
+          }
+        } while(r == input_t::PARSED ||
+                r == input_t::INVALID);
+        if (r == input_t::END)
+        {
+          close(src->input.fd);
+          if (src->kind == source_t::FIFO)
+          {
+            // wait for the next writer
+            src->input.reset();
+            src->binary_ids.clear();
+            src->input.fd = open_fifo(src->path);
+            if (src->input.fd >= 0)
+            {
+              ++src;
+              continue;
+            }
+          }
+          src = sources.erase(src);
+          continue;
+        }
+        ++src;
+      }
+      if (sources.empty())
+      {
+        // the coalesced sample is not dropped at the end of input
+        while(! latest_ids.empty())
+        {
+          push_latest();
+          queue.flush();
+          usleep(1000);
+        }
+        push(record_t{record_t::END, 0, 0, 0, nullptr});
+        queue.flush();
+        return;
+      }
+      // pass the records to the main thread before waiting for more input.
+      // a coalesced sample is pushed as soon as there is space in the queue.
+      queue.flush();
+      pfds.resize(sources.size());
+      size_t i = 0;
+      for(const auto &src : sources)
+      {
+        pfds[i].fd = src.input.fd;
+        pfds[i].events = POLLIN;
+        pfds[i].revents = 0;
+        ++i;
+      }
+      // the --shm ring is checked after SHM_POLL_MS
+      if (poll(pfds.data(), pfds.size(), ! latest_ids.empty() ? 1 : shm_name ? SHM_POLL_MS : -1) > 0)
+      {
+        // accepted connections are added to the end of sources
+        auto src = sources.begin();
+        for(i = 0; i < pfds.size(); ++i, ++src)
+        {
+          if (pfds[i].revents == 0)
+            continue;
+          if (src->kind == source_t::DATAGRAM)
+          {
+            src->input.receive();
+          }
+          else if (src->kind == source_t::LISTEN)
+          {
+            const int fd = accept(src->input.fd, NULL, NULL);
+            if (fd >= 0)
+            {
+              sources.emplace_back();
+              sources.back().input.fd = fd;
+            }
+          }
+          else
+          {
+            src->input.append();
+          }
+        }
+        rec.us = getus();
+      }
+      push_latest();
+    }
+  };
+  // signals are handled by the main thread
+  sigset_t sigs, old_sigs;
+  sigemptyset(&sigs);
+  sigaddset(&sigs, SIGWINCH);
+  sigaddset(&sigs, SIGINT);
+  sigaddset(&sigs, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &sigs, &old_sigs);
+  std::thread reader(read_input);
+  pthread_sigmask(SIG_SETMASK, &old_sigs, NULL);
+
+  // generation of the last sample or line of key/value pairs
+  size_t gen = restored.gen;
+  // the last frame drawn on the screen
+  frame_t drawn;
+  // ids of the plotted graphs in drawing order
+  std::vector<size_t> shown;
+  // page of the details if they do not fit below the plot and the number of pages
+  size_t page = 0, pages = 1;
+  // attributes of the graphs in drawing order
+  std::vector<int> attrs;
+  // dots of the --braille plot
+  braille_t canvas;
+  // transform of -F and the spectra of --waterfall
+  fft_t fft;
+  waterfall_t history;
+  // order of the bars in the columns of -k -b
+  bar_order_t bar_order;
+  // true if the screen needs to be redrawn, the graphs of --state are drawn before the first input
+  bool dirty = restored.gen > 0;
+  // true if the status line with the metrics is shown
+  bool show_status = false;
+  // with --replay and --speed max the screen is only drawn at the end of the file
+  bool hold = replay && speed == 0;
+  // true if the replayed file ended and the plot is shown until q is pressed
+  bool replay_end = false;
+  // in fps mode the time when the next screen refresh is allowed.
+  // otherwise the time when the screen is refreshed even if more input is available.
+  size_t next_frame = 0;
+  // time when the graphs are written to the --state file again
+  size_t next_state = getms() + STATE_MS;
+  // errno of the last failed write of the --state file, 0 if it was written
+  int state_errno = 0;
+  auto write_state = [&]() {
+    state_t s = restored;
+    s.gen = gen;
+    s.time = gettime();
+    s.global_max = global_max;
+    s.global_min = global_min;
+    s.t1 = t1;
+    s.td = td;
+    state_errno = save_state(state_fn, s) ? 0 : errno;
+    next_state = getms() + STATE_MS;
+  };
   while(1)
   {
-    double td = 1;
+    if (stop_received)
+    {
+      break;
+    }
     if (sigwinch_received)
     {
       sigwinch_received = false;
-      endwin();
+      if (sp)
+      {
+        endwin();
+      }
+      dirty = true;
+      drawn = frame_t();
     }
-    int r = 0;
-    if (op_mode == OperatingMode::ONE)
+    const auto t2 = getms();
+    // if the screen needs to be redrawn, only check for input which is already
+    // available, in fps mode wait until the next screen refresh is due.
+    // In bucket mode the screen is redrawn when the next bucket starts.
+    int timeout = -1;
+    if (dirty)
     {
-      double v;
-      r = scanf("%lf", &v);
-      if (r == 1)
+      timeout = (fps > 0 && t2 < next_frame) ? next_frame - t2 : 0;
+    }
+    else if (values_t::bucket_ms > 0 &&
+             gen > 0 &&
+             ! replay_end)
+    {
+      timeout = values_t::bucket_ms - (t2 - start_ms) % values_t::bucket_ms;
+    }
+
+    // add the records of one sample or line of key/value pairs to the graphs
+    input_t::result_t r = input_t::MORE;
+    record_t rec;
+    // time of the sample in seconds
+    double sample_ts = 0;
+    while(queue.pop(rec))
+    {
+      if (rec.kind == record_t::SAMPLE)
+      {
+        // in bucket mode the bucket of the time the sample was read
+        const size_t ms = rec.us / 1000u;
+        const size_t sample_gen = (values_t::bucket_ms > 0) ? restored.gen + (ms - std::min(ms, start_ms)) / values_t::bucket_ms + 1 : gen + 1;
+        gen = std::max(gen, sample_gen);
+        sample_ts = rec.value;
+        if (rate)
+        {
+          // the interval shown on the screen, each graph uses the time of its previous value
+          if (t1 != DOUBLE_UNINIT &&
+              sample_ts > t1)
+          {
+            td = sample_ts - t1;
+          }
+          t1 = sample_ts;
+        }
+        r = input_t::PARSED;
+      }
+      else if (rec.kind == record_t::VALUE)
+      {
+        push_back(rec.id, rec.value, gen, plotwidth, bars, rate, sample_ts);
+        r = input_t::PARSED;
+      }
+      else if (rec.kind == record_t::KEY)
       {
-        push_back(one_str, v, plotwidth, bars);
+        const size_t id = values.id(rec.key->data(), rec.key->size());
+        assert(id == rec.id);
+        (void) id;
+        delete rec.key;
       }
+      else
+      {
+        r = input_t::END;
+        break;
+      }
+      const record_t *next = queue.peek();
+      if (! next ||
+          next->kind == record_t::SAMPLE ||
+          next->kind == record_t::END)
+        break;
     }
-    else if (op_mode == OperatingMode::TWO)
+
+    if (r == input_t::END)
     {
-      double v1, v2;
-      r = scanf("%lf %lf", &v1, &v2);
-      if (r == 2)
+      hold = false;
+      if (replay &&
+          tty_fd >= 0)
+      {
+        // keep the replayed plot on the screen
+        replay_end = true;
+        dirty = true;
+        r = input_t::PARSED;
+      }
+      // draw the remaining input before exiting
+      else if (! dirty)
       {
-        push_back(one_str, v1, plotwidth, bars);
-        push_back(two_str, v2, plotwidth, bars);
+        break;
       }
     }
-    else if (op_mode == OperatingMode::KV)
+    else if (r == input_t::MORE)
     {
-      // clear the push_back flag for all values
-      for(auto &p : values)
+      const short revents = queue.wait(timeout, tty_fd);
+      if (revents & (POLLERR | POLLHUP | POLLNVAL))
       {
-        p.second.did_push_back = false;
+        tty_fd = -1;
       }
-      // read a line from STDIN
-      std::string line;
-      std::getline(std::cin, line);
-      // parse line for key/value pairs
-      std::istringstream is(line);
-      while(is)
+      else if (revents)
       {
-        std::string key;
-        is >> key;
-        if (! is)
-          break;
-        double v;
-        is >> v;
-        if (! is)
+        const auto zoom = values_t::zoom;
+        bool quit = false;
+        int ch;
+        while((ch = ansi_output ? ansi.key() : getch()) != ERR)
+        {
+          if (ch == '-' &&
+              values_t::zoom + 1 < ZOOM_LEVELS)
+          {
+            ++values_t::zoom;
+          }
+          else if ((ch == '+' || ch == '=') &&
+                   values_t::zoom > 0)
+          {
+            --values_t::zoom;
+          }
+          else if (ch == 's')
+          {
+            show_status = ! show_status;
+            dirty = true;
+            drawn = frame_t();
+          }
+          else if (ch == KEY_NPAGE ||
+                   ch == KEY_PPAGE)
+          {
+            page = (ch == KEY_NPAGE) ? page + 1 : (page > 0 ? page : pages) - 1;
+            dirty = true;
+            drawn = frame_t();
+          }
+          else if (ch == 'a' &&
+                   ! values_t::quantiles.empty())
+          {
+            values_t::all_time = ! values_t::all_time;
+            dirty = true;
+            drawn = frame_t();
+          }
+          else if (ch == 'q' &&
+                   replay_end)
+          {
+            quit = true;
+          }
+        }
+        if (quit)
+        {
           break;
-        push_back(key, v, plotwidth, bars);
-        ++r;
-      }
-      // push the uninitialized value for all values which did not parse a key/value pair
-      for(auto &p : values)
-      {
-        if (p.second.did_push_back == false)
+        }
+        if (values_t::zoom != zoom)
         {
-          p.second.push_back(DOUBLE_UNINIT, plotwidth, bars);
-          assert(p.second.did_push_back);
+          dirty = true;
+          drawn = frame_t();
         }
       }
+      if (! queue.empty())
+      {
+        continue;
+      }
+      // timeout expired or a signal was received.
+      // in bucket mode move the plot to the next bucket.
+      if (values_t::bucket_ms > 0 &&
+          ! dirty &&
+          gen > 0 &&
+          ! replay_end)
+      {
+        dirty = true;
+        gen = std::max(gen, restored.gen + (getms() - start_ms) / values_t::bucket_ms + 1);
+      }
+      // all available input was parsed. Without --fps the screen is redrawn now,
+      // DRAIN_MS only limits how long input which keeps arriving delays it.
+      if (! dirty ||
+          hold ||
+          (fps > 0 && getms() < next_frame))
+      {
+        continue;
+      }
     }
     else
     {
-      assert(false);
+      // parse all available input before the screen is redrawn
+      const auto now = getms();
+      if (! dirty)
+      {
+        dirty = true;
+        if (fps == 0)
+        {
+          next_frame = now + DRAIN_MS;
+        }
+      }
+      if (hold ||
+          now < next_frame)
+      {
+        continue;
+      }
     }
 
-    if (r == 0)
+    dirty = false;
+    if (fps > 0)
     {
-      while(getchar()!='\n') {}
-      continue;
+      next_frame = getms() + 1000 / fps;
     }
-    else if (r < 0)
+    const auto frame_start = getus();
+    if (state_fn &&
+        getms() >= next_state)
     {
-      break;
+      write_state();
     }
 
-    if (rate)
+    if (headless != Headless::NONE)
     {
-      const auto prev_ts = t1;
-      t1 = getms();
-      assert(prev_ts <= t1);
-      const auto tdiff = t1 - prev_ts;
-      if (tdiff == 0)
-      {
-        td = 1;
-      }
-      else
+      for(const auto id : values.sorted())
       {
-        td = tdiff / 1000.0;
+        values[id].catch_up(gen, plotwidth);
       }
-      for(auto &p : values)
+      headless_summary(stdout, headless, gettime());
+      metrics.update_rate(getms());
+      metrics.frame(getus() - frame_start, 0);
+      if (r == input_t::END)
       {
-        p.second.rate(td);
+        break;
       }
+      continue;
     }
 
-    erase();
-#ifdef _AIX
-    refresh();
-#endif
+    if (ansi_output)
+    {
+      ansi.size(screenwidth, screenheight);
+    }
+    else
+    {
 #ifdef NOGETMAXYX
-    screenheight=LINES;
-    screenwidth=COLS;
+      screenheight=LINES;
+      screenwidth=COLS;
 #else
-    getmaxyx(stdscr, screenheight, screenwidth);
+      getmaxyx(stdscr, screenheight, screenwidth);
 #endif
-    if (screenheight < 8)
+    }
+    fb.resize(screenwidth, screenheight);
+    if (screenheight < 8 ||
+        screenwidth < 40)
     {
-      mvprintw(0,0,"screen height too small");
-      refresh();
+      fb.blank();
+      fb.text(0, 0, (screenheight < 8) ? "screen height too small" : "screen width too small");
+      present(true);
+      drawn = frame_t();
       continue;
     }
-    if (screenwidth < 40)
+    plotwidth = (screenwidth - 1) * (braille ? BRAILLE_X : spectrum ? SPECTRUM_X : 1);
+
+    const auto update_start = getus();
+    for(const auto id : values.sorted())
     {
-      mvprintw(0,0,"screen width too small");
-      refresh();
-      continue;
+      values[id].catch_up(gen, plotwidth);
+    }
+    shown = values.sorted();
+    if (top > 0 &&
+        shown.size() > top)
+    {
+      // select the top graphs without sorting all graphs
+      std::nth_element(shown.begin(), shown.begin() + top - 1, shown.end(), [&](const size_t a, const size_t b) {
+          return values[a].rank(top_by) > values[b].rank(top_by);
+        });
+      shown.resize(top);
+      // the graphs keep their order and colors when their ranks change
+      std::sort(shown.begin(), shown.end(), [&](const size_t a, const size_t b) {
+          return values[a].key < values[b].key;
+        });
     }
+
     if (screenwidth < SCREENWIDTH_FOR_2COLUMN)
     {
-      plotheight = screenheight - values.size() - 1;
+      plotheight = screenheight - shown.size() - 1;
     }
     else
     {
-      plotheight = screenheight - values.size() / 2 - 2;
+      plotheight = screenheight - shown.size() / 2 - 2;
+    }
+    // the status line is printed below the x axis
+    if (show_status)
+    {
+      --plotheight;
     }
     if (plotheight < screenheight / 2)
     {
       plotheight = screenheight / 2;
     }
-    plotwidth = screenwidth - 1;
-
-    for(auto &p : values)
+    // range of the visible values
+    double visible_max = DOUBLE_MIN;
+    double visible_min = DOUBLE_MAX;
+    for(const auto id : shown)
     {
-      auto &vals = p.second;
+      auto &vals = values[id];
+      // values which were added since the last frame and already left the plot
+      if (vals.seq - vals.drawn_seq > vals.window)
+      {
+        metrics.undrawn += vals.seq - vals.drawn_seq - vals.window;
+      }
       vals.update();
-      if (vals.max > global_max)
+      visible_max = std::max(visible_max, vals.max);
+      visible_min = std::min(visible_min, vals.min);
+    }
+    if (spectrum &&
+        ! shown.empty())
+    {
+      // with -F the scale is the range of the amplitudes. The FFT uses the largest
+      // power of 2 values which fit into the plot.
+      size_t n = 4;
+      while(n * 2 <= static_cast<size_t>(plotwidth))
+        n *= 2;
+      fft.init(n);
+      const size_t every = fft_every ? fft_every : n / 4;
+      visible_max = 0;
+      visible_min = 0;
+      for(const auto id : shown)
+      {
+        auto &vals = values[id];
+        const bool calculated = vals.update_spectrum(fft, every);
+        if (! waterfall)
+        {
+          visible_max = std::max(visible_max, *std::max_element(vals.spectrum.begin(), vals.spectrum.end()));
+        }
+        else if (id == shown[0] &&
+                 calculated)
+        {
+          history.add(vals.spectrum, screenheight);
+        }
+      }
+      if (waterfall)
+      {
+        visible_max = history.max();
+      }
+    }
+    if (visible_max < visible_min)
+    {
+      // no graphs
+    }
+    else if (! autoscale)
+    {
+      // the scale only grows
+      global_max = std::max(global_max, visible_max);
+      global_min = std::min(global_min, visible_min);
+    }
+    else if (visible_max > global_max ||
+             visible_min < global_min ||
+             (global_max - visible_max) + (visible_min - global_min) > AUTOSCALE_SHRINK * (global_max - global_min))
+    {
+      // the scale grows if a value is outside and shrinks if a large part is unused.
+      // Between the two the scale is kept, so the plot is not redrawn for every small change.
+      double range = visible_max - visible_min;
+      if (range <= 0)
       {
-        global_max = vals.max;
+        range = (visible_max != 0) ? fabs(visible_max) : 1;
       }
-      if (vals.min < global_min)
+      global_max = visible_max + range * AUTOSCALE_HEADROOM;
+      global_min = visible_min - range * AUTOSCALE_HEADROOM;
+      // no negative scale for positive values
+      if (visible_min >= 0 &&
+          global_min < 0)
       {
-        global_min = vals.min;
+        global_min = 0;
       }
     }
 
@@ -875,47 +5997,14 @@ main(int argc, char *argv[])
       global_min = softmin;
     if (hardmin != DOUBLE_MIN)
       global_min = hardmin;
+    const auto update_us = getus() - update_start;
 
-    // print current time
-    {
-      time_t t = time(NULL);
-      char ls[32];
-      auto lt = localtime(&t);
-#ifdef __sun
-      asctime_r(lt, ls, sizeof(ls));
-#else
-      asctime_r(lt, ls);
-#endif
-      auto len = strlen(ls);
-      assert(len > 10);
-      // strip trailing NL character
-      if (ls[len - 1] == '\n')
-      {
-        ls[--len] = 0;
-      }
-      mvprintw(screenheight-1, screenwidth-len, "%s", ls);
-    }
-    // print program version string
-    if (values.size() >= 2)
-    {
-      mvprintw(screenheight-2, screenwidth-sizeof(verstring)+1, verstring);
-    }
-
-    if (rate)
-    {
-      std::string s = "interval=";
-      s += std::to_string(td);
-      while(s.back() == '0')
-        s.pop_back();
-      s += 's';
-      mvprintw(screenheight-1, screenwidth/2 - s.size()/2,"%s", s.c_str());
-    }
-
-    draw_axes(plotheight, plotwidth);
-    int idx = 0;
+    // attributes of the graphs
+    attrs.clear();
     char last_plotchar = 0;
-    for(const auto &p : values)
+    for(const auto id : shown)
     {
+      const int idx = attrs.size();
       int attr = 0;
       // did we parse colors?
       if (parsed_colors > 0)
@@ -948,7 +6037,7 @@ main(int argc, char *argv[])
         if (op_mode == OperatingMode::KV)
         {
           // check if the previous data point used the same plotchar
-          const char plotchar = p.first[0];
+          const char plotchar = values[id].key[0];
           if (plotchar == last_plotchar)
           {
             // set a font attribute to better distinguish the same plotchars
@@ -958,27 +6047,338 @@ main(int argc, char *argv[])
           last_plotchar = plotchar;
         }
       }
+      attrs.push_back(attr);
+    }
+
+    // plot columns [x_begin, x_end) of all graphs
+    auto plot = [&](const size_t x_begin, const size_t x_end) {
+      if (waterfall)
+      {
+        fb.attr = attrs.empty() ? A_NORMAL : attrs[0];
+        history.draw(screenwidth - 1, plotheight, global_max, global_min);
+        fb.attr = A_NORMAL;
+        return;
+      }
+      if (spectrum)
+      {
+        // the spectra change completely, the plot is not drawn incrementally
+        for(size_t idx = 0; idx < shown.size(); ++idx)
+        {
+          fb.attr = attrs[idx];
+          values[shown[idx]].plot_spectrum(screenwidth - 1, plotheight, global_max, global_min, max_errchar, hardmax);
+          fb.attr = A_NORMAL;
+        }
+        return;
+      }
+      if (braille)
+      {
+        // the dots of all graphs are drawn, the plot is not drawn incrementally
+        canvas.clear(screenwidth - 1, plotheight);
+        for(size_t idx = 0; idx < shown.size(); ++idx)
+        {
+          const auto &vals = values[shown[idx]];
+          vals.plot(0, SIZE_MAX, plotheight * BRAILLE_Y, global_max, global_min, max_errchar, min_errchar, hardmax, [&](const int x, const int y1, const int y2, const int pc) {
+              canvas.line(x, y1, y2, (pc == vals.name[0]) ? 0 : pc, attrs[idx]);
+            });
+        }
+        canvas.draw();
+        return;
+      }
+      if (bars &&
+          op_mode == OperatingMode::KV &&
+          ! shown.empty())
+      {
+        // the bars of each column are drawn from the highest to the lowest
+        const auto &first = values[shown[0]];
+        const size_t cols = first.cols();
+        size_t factor = 1;
+        for(unsigned i = 0; i < values_t::zoom; ++i)
+        {
+          factor *= ZOOM_FACTOR;
+        }
+        // number of the last column, generation g is in column (g-1)/factor
+        const size_t last_col = (first.gen > 0) ? (first.gen - 1) / factor : 0;
+        const bool last_changing = values_t::zoom > 0 || values_t::bucket_ms > 0;
+        bar_order.reset(shown, values_t::zoom);
+        for(size_t x = x_begin; x < std::min(x_end, cols); ++x)
+        {
+          const auto &order = bar_order.order(last_col + 1 + x - cols, cols, last_changing && x + 1 == cols, [&](const uint32_t idx) {
+              return values[shown[idx]].bar(x);
+            });
+          for(const auto idx : order)
+          {
+            fb.attr = attrs[idx];
+            values[shown[idx]].plot(x, x + 1, plotheight, global_max, global_min, max_errchar, min_errchar, hardmax);
+            fb.attr = A_NORMAL;
+          }
+        }
+        return;
+      }
+      size_t idx = 0;
+      for(const auto id : shown)
+      {
+        fb.attr = attrs[idx];
+        values[id].plot(x_begin, x_end, plotheight, global_max, global_min, max_errchar, min_errchar, hardmax);
+        fb.attr = A_NORMAL;
+        ++idx;
+      }
+    };
+
+    frame_t frame;
+    frame.screenwidth = screenwidth;
+    frame.screenheight = screenheight;
+    frame.plotheight = plotheight;
+    frame.graphs = shown;
+    frame.max = global_max;
+    frame.min = global_min;
+    frame.gen = gen;
+    if (! shown.empty())
+    {
+      frame.cols = values[shown[0]].cols();
+    }
+
+    // if the layout and scale did not change and all graphs advanced by the same
+    // number of values, move the plot to the left and only draw the new columns.
+    // If zoomed out the last column of each graph changes with every value.
+    const size_t new_cols = gen - drawn.gen;
+    bool incremental = frame.same_layout(drawn) && new_cols < frame.cols && values_t::zoom == 0 && ! braille && ! spectrum;
+    for(size_t i = 0; incremental && i < shown.size(); ++i)
+    {
+      const auto &vals = values[shown[i]];
+      incremental = vals.cols() == frame.cols &&
+        vals.seq - vals.drawn_seq == new_cols;
+    }
+    if (incremental)
+    {
+      const size_t shift = drawn.cols + new_cols - frame.cols;
+      shift_plot(plotheight, plotwidth, shift);
+      // draw the new columns. In bucket mode the last drawn bucket may have
+      // received more samples.
+      const size_t redraw = std::min(frame.cols, new_cols + (values_t::bucket_ms > 0 ? 1 : 0));
+      clear_plot(frame.cols - redraw, frame.cols, plotheight);
+      plot(frame.cols - redraw, frame.cols);
+      // the first column lost the value left of it
+      if (shift > 0)
+      {
+        clear_plot(0, 1, plotheight);
+        plot(0, 1);
+      }
+      // values hidden under the title moved left of the title
+      if (title && shift > 0)
+      {
+        const size_t title_x = (screenwidth/2)-(strlen(title)/2)-1;
+        if (title_x > shift)
+        {
+          // screen column x displays the value with index x-1
+          const size_t x_begin = title_x - shift - 1;
+          const size_t x_end = std::min(title_x - 1, frame.cols - new_cols);
+          clear_plot(x_begin, x_end, plotheight);
+          plot(x_begin, x_end);
+        }
+      }
+      // clear the details below the x axis
+      for(int y = plotheight + 1; y < screenheight; ++y)
+      {
+        fb.horizontal(y, 0, ' ', screenwidth);
+      }
+    }
+    else
+    {
+      fb.blank();
+#ifdef _AIX
+      erase();
+      refresh();
+#endif
+      draw_axes(plotheight, screenwidth - 1);
+      plot(0, SIZE_MAX);
+    }
+    // the terminal is cleared if the scale changed, as most cells change
+    const bool rescaled = frame.max != drawn.max || frame.min != drawn.min;
+    drawn = frame;
+    for(size_t id = 0; id < values.size(); ++id)
+    {
+      values[id].drawn_seq = values[id].seq;
+    }
+
+    // print current time
+    {
+      time_t t = time(NULL);
+      char ls[32];
+      auto lt = localtime(&t);
+#ifdef __sun
+      asctime_r(lt, ls, sizeof(ls));
+#else
+      asctime_r(lt, ls);
+#endif
+      auto len = strlen(ls);
+      assert(len > 10);
+      // strip trailing NL character
+      if (ls[len - 1] == '\n')
+      {
+        ls[--len] = 0;
+      }
+      fb.text(screenheight-1, screenwidth-len, ls);
+    }
+    // print program version string
+    if (values.size() >= 2)
+    {
+      fb.text(screenheight-2, screenwidth-sizeof(verstring)+1, verstring);
+    }
+
+    if (rate)
+    {
+      std::string s = "interval=";
+      s += std::to_string(td);
+      while(s.back() == '0')
+        s.pop_back();
+      s += 's';
+      fb.text(screenheight-1, screenwidth/2 - s.size()/2, s.c_str());
+    }
+
+    // print the number of values in a column and if the quantiles use all samples on the x axis
+    {
+      std::string s;
+      if (values_t::zoom > 0)
+      {
+        size_t factor = 1;
+        for(unsigned i = 0; i < values_t::zoom; ++i)
+        {
+          factor *= ZOOM_FACTOR;
+        }
+        s = " 1:" + std::to_string(factor);
+      }
+      if (values_t::all_time)
+      {
+        s += " all";
+      }
+      if (! s.empty())
+      {
+        s += ' ';
+        fb.text(plotheight, screenwidth - 2 - s.size(), s.c_str());
+      }
+    }
 
-      attron(attr);
-      p.second.plot(idx, screenwidth, plotheight, global_max, global_min, max_errchar, min_errchar, hardmax);
-      attroff(attr);
+    // with -F print the period in values of the frequencies at a quarter, half and three quarters of the x axis
+    if (spectrum &&
+        fft.n > 0)
+    {
+      const int cols = screenwidth - 1;
+      for(int q = 1; q < 4; ++q)
+      {
+        const int x = cols * q / 4;
+        const size_t bin = 1 + (x - 1) * (fft.n / 2) / cols;
+        char buf[FORMAT_SIZE];
+        fb.print(plotheight, x, " T=%s ", printValue(buf, static_cast<double>(fft.n) / bin));
+      }
+    }
 
-      ++idx;
+    // print the details of the graphs which fit below the plot, the others are on further pages
+    {
+      const int details_y = show_status ? plotheight + 1 : plotheight;
+      size_t per_page = std::max(screenheight - 1 - details_y, 1);
+      if (screenwidth >= SCREENWIDTH_FOR_2COLUMN)
+      {
+        per_page *= 2;
+      }
+      size_t begin = 0, end = shown.size();
+      pages = (shown.size() + per_page - 1) / per_page;
+      if (pages > 1)
+      {
+        page %= pages;
+        begin = page * per_page;
+        end = std::min(begin + per_page, shown.size());
+        const std::string s = " " + std::to_string(page + 1) + "/" + std::to_string(pages) + " ";
+        fb.text(plotheight, 2, s.c_str());
+      }
+      else
+      {
+        page = 0;
+      }
+      for(size_t idx = begin; idx < end; ++idx)
+      {
+        fb.attr = attrs[idx];
+        values[shown[idx]].details(idx - begin, screenwidth, details_y);
+        fb.attr = A_NORMAL;
+      }
     }
 
-    draw_labels(plotheight, global_max, global_min, unit);
+    if (waterfall)
+    {
+      // the rows of the waterfall are spectra, the highest character is the top of the scale
+      char buf[FORMAT_SIZE];
+      fb.attr = A_BOLD;
+      const int x = fb.print(0, 1, "%c=%s", WATERFALL_CHARS[sizeof(WATERFALL_CHARS) - 2], printValue(buf, global_max));
+      if (unit)
+      {
+        fb.text(0, fb.text(0, x, " "), unit);
+      }
+      fb.attr = A_NORMAL;
+    }
+    else
+    {
+      draw_labels(plotheight, global_max, global_min, unit);
+    }
     if (title)
     {
-      attron(A_BOLD);
-      mvprintw(0, (screenwidth/2)-(strlen(title)/2)-1, " %s ", title);
-      attroff(A_BOLD);
+      fb.attr = A_BOLD;
+      fb.print(0, (screenwidth/2)-(strlen(title)/2)-1, " %s ", title);
+      fb.attr = A_NORMAL;
     }
 
-    move(0,0);
-    refresh();
+    metrics.update_rate(getms());
+    metrics.backlog = readable(STDIN_FILENO);
+    metrics.queued = queue.size();
+    metrics.queued_max = std::max(metrics.queued_max, metrics.queued);
+    metrics.backlog_max = std::max(metrics.backlog_max, metrics.backlog);
+    if (show_status)
+    {
+      metrics.status(plotheight + 1, screenwidth);
+    }
+
+    present(rescaled);
+    metrics.frame(getus() - frame_start, update_us);
+
+    if (r == input_t::END)
+    {
+      break;
+    }
   }  // while 1
+  if (stop_received)
+  {
+    if (headless != Headless::NONE)
+    {
+      headless_summary(stdout, headless, gettime());
+    }
+  }
+  else
+  {
+    reader.join();
+  }
+  if (state_fn)
+  {
+    write_state();
+  }
 
-  endwin();
-  delscreen(sp);
+  if (sp)
+  {
+    endwin();
+    delscreen(sp);
+  }
+  ansi.end();
+  if (state_errno)
+  {
+    errno = state_errno;
+    perror(state_fn);
+  }
+  if (print_stats)
+  {
+    metrics.dump(stderr);
+  }
+  if (stop_received)
+  {
+    // the reader thread may wait for input, so ttyplot exits without joining it
+    exit(EXIT_SUCCESS);
+  }
   return EXIT_SUCCESS;
 }
+#endif
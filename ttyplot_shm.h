@@ -0,0 +1,156 @@
+/** @file
+ * ttyplot_shm: shared memory ring buffer which a producer writes and ttyplot --shm NAME reads.
+ * Apache License 2.0
+ *
+ * The ring is a POSIX shared memory object with one writer. A sample is the values written
+ * between two calls of ttyplot_shm_commit(), like a line of key/value pairs. Without -k the key 0
+ * is the value, with -2 the keys 0 and 1 are the two values. Writing a value does not call the kernel.
+ *
+ *   struct ttyplot_shm *shm = ttyplot_shm_create("/myapp");
+ *   const uint32_t rps = ttyplot_shm_key(shm, "rps");
+ *   ttyplot_shm_value(shm, rps, 1234);
+ *   ttyplot_shm_commit(shm);
+ *
+ * The functions use the __atomic builtins of GCC and clang. Link with -lrt on old C libraries.
+ */
+
+#ifndef TTYPLOT_SHM_H
+#define TTYPLOT_SHM_H
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* "TTYP" */
+#define TTYPLOT_SHM_MAGIC 0x50595454u
+#define TTYPLOT_SHM_VERSION 1
+/* number of slots, a power of 2 */
+#define TTYPLOT_SHM_SLOTS 65536
+#define TTYPLOT_SHM_KEYS 256
+/* maximum key length including the terminating 0 */
+#define TTYPLOT_SHM_KEY_SIZE 64
+/* key of a slot with the timestamp of the sample, used by ttyplot --timestamps */
+#define TTYPLOT_SHM_TIME 0xffffffffu
+/* returned by ttyplot_shm_key() if the key table is full or the key is empty */
+#define TTYPLOT_SHM_NOKEY 0xfffffffeu
+
+struct ttyplot_shm_slot
+{
+  uint32_t key;
+  /* 1 in the first slot of a sample */
+  uint32_t first;
+  double value;
+};
+
+struct ttyplot_shm
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slots;
+  uint32_t keys;
+  /* number of slots which were written or are being written, slot i is in slot[i % slots] */
+  uint64_t head;
+  /* number of slots of committed samples, the reader reads up to seq */
+  uint64_t seq;
+  /* number of keys in key */
+  uint32_t nkeys;
+  uint32_t reserved;
+  char key[TTYPLOT_SHM_KEYS][TTYPLOT_SHM_KEY_SIZE];
+  struct ttyplot_shm_slot slot[TTYPLOT_SHM_SLOTS];
+};
+
+/**
+ * create or open the shared memory object @p name, for example "/myapp".
+ * A ring of an earlier producer keeps its keys and sequence, so a running ttyplot continues.
+ * @return the mapped ring, NULL on error with errno set.
+ */
+static inline struct ttyplot_shm*
+ttyplot_shm_create(const char *name)
+{
+  const int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+  if (fd < 0)
+    return NULL;
+  if (ftruncate(fd, sizeof(struct ttyplot_shm)) != 0)
+  {
+    close(fd);
+    return NULL;
+  }
+  void *p = mmap(NULL, sizeof(struct ttyplot_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+    return NULL;
+  struct ttyplot_shm *shm = (struct ttyplot_shm*) p;
+  if (shm->magic != TTYPLOT_SHM_MAGIC ||
+      shm->version != TTYPLOT_SHM_VERSION ||
+      shm->slots != TTYPLOT_SHM_SLOTS ||
+      shm->keys != TTYPLOT_SHM_KEYS)
+  {
+    memset(shm, 0, sizeof(*shm));
+    shm->slots = TTYPLOT_SHM_SLOTS;
+    shm->keys = TTYPLOT_SHM_KEYS;
+    shm->version = TTYPLOT_SHM_VERSION;
+    __atomic_store_n(&shm->magic, TTYPLOT_SHM_MAGIC, __ATOMIC_RELEASE);
+  }
+  /* values of an uncommitted sample are dropped */
+  shm->head = shm->seq;
+  return shm;
+}
+
+/**
+ * @return the id of @p key, which is added to the key table if it is new.
+ *         The id should be kept, as the key table is searched.
+ * @return TTYPLOT_SHM_NOKEY if the table is full or @p key is empty.
+ */
+static inline uint32_t
+ttyplot_shm_key(struct ttyplot_shm *shm, const char *key)
+{
+  const uint32_t n = shm->nkeys;
+  uint32_t i;
+  if (key[0] == 0)
+    return TTYPLOT_SHM_NOKEY;
+  for(i = 0; i < n; ++i)
+  {
+    if (strncmp(shm->key[i], key, TTYPLOT_SHM_KEY_SIZE - 1) == 0)
+      return i;
+  }
+  if (n >= TTYPLOT_SHM_KEYS)
+    return TTYPLOT_SHM_NOKEY;
+  strncpy(shm->key[n], key, TTYPLOT_SHM_KEY_SIZE - 1);
+  shm->key[n][TTYPLOT_SHM_KEY_SIZE - 1] = 0;
+  /* the key is visible before the key count */
+  __atomic_store_n(&shm->nkeys, n + 1, __ATOMIC_RELEASE);
+  return n;
+}
+
+/** add @p value of the key with id @p key to the current sample. */
+static inline void
+ttyplot_shm_value(struct ttyplot_shm *shm, const uint32_t key, const double value)
+{
+  const uint64_t h = shm->head;
+  /* a reader sees that the slot h - slots is overwritten before it changes */
+  __atomic_store_n(&shm->head, h + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  struct ttyplot_shm_slot *s = &shm->slot[h & (TTYPLOT_SHM_SLOTS - 1)];
+  s->key = key;
+  s->first = (h == shm->seq);
+  s->value = value;
+}
+
+/** set the timestamp in seconds of the current sample, call it before the values. */
+static inline void
+ttyplot_shm_time(struct ttyplot_shm *shm, const double ts)
+{
+  ttyplot_shm_value(shm, TTYPLOT_SHM_TIME, ts);
+}
+
+/** end the current sample, its values can be read by ttyplot. */
+static inline void
+ttyplot_shm_commit(struct ttyplot_shm *shm)
+{
+  __atomic_store_n(&shm->seq, shm->head, __ATOMIC_RELEASE);
+}
+
+#endif